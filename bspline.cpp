@@ -0,0 +1,113 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//bspline.cpp
+#include "bspline.hpp"
+
+BSplineInterpolator::BSplineInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const boost::array<int,3>& nkpoints){
+  
+  for(int l=0;l<3;l++){ //the repeated last point along each axis is dropped
+    ncoefs[l] = max(nkpoints[l] - 1, 1);
+  }
+  
+  vector<fptype> values(long(ncoefs[0])*ncoefs[1]*ncoefs[2]);
+  for(int i1=0;i1<ncoefs[0];i1++){
+    for(int i2=0;i2<ncoefs[1];i2++){
+      for(int i3=0;i3<ncoefs[2];i3++){
+	values[(long(i1)*ncoefs[1] + i2)*ncoefs[2] + i3] = data[i1][i2][i3];
+      }
+    }
+  }
+  for(int l=0;l<3;l++){ //the tensor product spline is prefiltered one axis after another
+    prefilter_axis(values, l);
+  }
+  coefs = make_shared<const vector<fptype> >(move(values));
+  
+  boost::const_multi_array_ref<fptype,3> view(coefs->data(), boost::extents[ncoefs[0]][ncoefs[1]][ncoefs[2]]);
+  grid = make_shared<const InterpolationGrid>(view, ncoefs);
+}
+
+void BSplineInterpolator::prefilter_axis(vector<fptype>& values, int axis){
+  
+  //the coefficients c solve (c[i-1] + 4c[i] + c[i+1])/6 = f[i], which factors into a causal and an anticausal
+  //first order recursion with the pole z, both are started with their periodic sums
+  const double z = sqrt(3.0) - 2;
+  int n = ncoefs[axis];
+  long stride = 1;
+  for(int l=2;l>axis;l--){
+    stride *= ncoefs[l];
+  }
+  long nouter = 1;
+  for(int l=0;l<axis;l++){
+    nouter *= ncoefs[l];
+  }
+  double zn = pow(z, n);
+  
+  #pragma omp parallel
+  {
+    vector<double> line(n);
+    #pragma omp for schedule(static)
+    for(long line_index=0;line_index<nouter*stride;line_index++){
+      fptype* c = values.data() + (line_index / stride)*n*stride + line_index % stride;
+      for(int i=0;i<n;i++){
+	line[i] = c[i*stride];
+      }
+      
+      double sum = line[0], zk = 1;
+      for(int k=1;k<n;k++){
+	zk *= z;
+	sum += zk*line[n-k];
+      }
+      line[0] = sum/(1 - zn);
+      for(int i=1;i<n;i++){
+	line[i] += z*line[i-1];
+      }
+      
+      sum = line[n-1];
+      zk = 1;
+      for(int k=1;k<n;k++){
+	zk *= z;
+	sum += zk*line[k-1];
+      }
+      line[n-1] = -z*sum/(1 - zn);
+      for(int i=n-2;i>=0;i--){
+	line[i] = z*(line[i+1] - line[i]);
+      }
+      
+      for(int i=0;i<n;i++){
+	c[i*stride] = 6*line[i];
+      }
+    }
+  }
+}
+
+fptype BSplineInterpolator::operator()(fptype x, fptype y, fptype z){
+  
+  return separable_cubic<CubicBSplineWeights>(*grid, x, y, z);
+}
+
+fptype BSplineInterpolator::operator()(fptype x, fptype y, fptype z, fptype* gradient){
+  
+  return separable_cubic<CubicBSplineWeights>(*grid, x, y, z, gradient);
+}
+
+void BSplineInterpolator::evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n){
+  
+  separable_cubic<CubicBSplineWeights>(*grid, 1, x, y, z, result, n);
+}
@@ -0,0 +1,52 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//bspline.hpp
+#include <vector>
+#include <memory>
+#include <boost/array.hpp>
+#include <boost/multi_array.hpp>
+
+#include "typedefs.hpp"
+#include "grid.hpp"
+#include "separable.hpp"
+
+using namespace std;
+
+#ifndef BSPLINE_INTERPOLATOR_H
+#define BSPLINE_INTERPOLATOR_H
+
+class BSplineInterpolator{
+  //Periodic cubic B-spline through the unique points of the band grid, its last point along each axis repeats the
+  //first one. The spline coefficients are obtained once with recursive filters along each axis, see
+  //Unser, M.: Splines: a perfect fit for signal and image processing. IEEE Signal Processing Magazine (1999), No. 16
+  //Evaluation does not modify the interpolator, copies share the coefficients.
+  public:
+    BSplineInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const boost::array<int,3>& nkpoints);
+    fptype operator()(fptype x, fptype y, fptype z);
+    fptype operator()(fptype x, fptype y, fptype z, fptype* gradient); //gradient in band grid spacings
+    void evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n);
+  private:
+    boost::array<int,3> ncoefs; //number of spline coefficients along each axis
+    shared_ptr<const vector<fptype> > coefs;
+    shared_ptr<const InterpolationGrid> grid; //periodic view on the coefficients
+    void prefilter_axis(vector<fptype>& values, int axis);
+};
+
+#endif
@@ -20,11 +20,9 @@
 //eval.cpp
 #include "eval.hpp"
 
-OrbitEvaluator::OrbitEvaluator(OrbitContainer* orbits, fptype sc_length_in, fptype nsc_in){
+OrbitEvaluator::OrbitEvaluator(const OrbitContainer& orbits, const SuperCellGrid& grid_in) : con(orbits){
   
-  sc_length = sc_length_in;
-  nsc = nsc_in;
-  con = *orbits;
+  grid = grid_in;
   nslices = con.get_slicecount();
   for(int i=0;i<nslices;i++){
     norbits.push_back(con.get_orbitcount(i));
@@ -35,38 +33,44 @@ OrbitEvaluator::OrbitEvaluator(OrbitContainer* orbits, fptype sc_length_in, fpty
 
 void OrbitEvaluator::calc_all(){
   
+  //the orbits are independent, all (slice, orbit) pairs are evaluated in parallel into their place in res
+  vector<pair<int,int> > pairs;
+  res.resize(nslices);
   for(int i=0;i<nslices;i++){
-    vector<EvaluatedOrbit> orbitsperslice;
+    res[i].resize(norbits[i]);
     for(int j=0;j<norbits[i];j++){
-      EvaluatedOrbit orb;
-      orb.f = calc_frequency(i, j);
-      orb.m = calc_mass(i, j);
-      orb.z = calc_z(i);
-      orb.cx = calc_center_x(i, j);
-      orb.cy = calc_center_y(i, j);
-      orb.sdevx = calc_standarddev_x(i, j, orb.cx);
-      orb.sdevy = calc_standarddev_y(i, j, orb.cy);
-      orb.minx = calc_min_x(i, j);
-      orb.maxx = calc_max_x(i, j);
-      orb.miny = calc_min_y(i, j);
-      orb.maxy = calc_max_y(i, j);
-      
-      //cout << orb.f << endl;
-
-      orbitsperslice.push_back(orb);
+      pairs.push_back(make_pair(i, j));
     }
-    res.push_back(orbitsperslice);
+  }
+  
+  int npairs = pairs.size();
+  #pragma omp parallel for schedule(dynamic, 16)
+  for(int n=0;n<npairs;n++){
+    int i = pairs[n].first, j = pairs[n].second;
+    EvaluatedOrbit orb;
+    orb.f = calc_frequency(i, j);
+    orb.m = calc_mass(i, j);
+    orb.z = calc_z(i);
+    orb.cx = calc_center_x(i, j);
+    orb.cy = calc_center_y(i, j);
+    orb.sdevx = calc_standarddev_x(i, j, orb.cx);
+    orb.sdevy = calc_standarddev_y(i, j, orb.cy);
+    orb.minx = calc_min_x(i, j);
+    orb.maxx = calc_max_x(i, j);
+    orb.miny = calc_min_y(i, j);
+    orb.maxy = calc_max_y(i, j);
+    res[i][j] = orb;
   }
 }
 
 fptype OrbitEvaluator::calc_frequency(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
   
-  fptype area = 0;
+  acctype area = 0;
   for(int i=0;i<(npoints-1);i++){
-    area += orbit[i].x * orbit[i+1].y - orbit[i+1].x * orbit[i].y;
+    area += acctype(orbit.x[i]) * orbit.y[i+1] - acctype(orbit.x[i+1]) * orbit.y[i];
   }
   area*=0.5;
   area = fabs(area);
@@ -77,15 +81,13 @@ fptype OrbitEvaluator::calc_frequency(int sliceindex, int orbitindex){
 
 fptype OrbitEvaluator::calc_mass(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
   
-  fptype effmass = 0; //effective mass in units of the free electron mass
+  acctype effmass = 0; //effective mass in units of the free electron mass
   for(int i=0;i<(npoints-1);i++){
-    fptype den = get_energy_derivative(orbit[i], orbit[i+1]);
-    fptype enu = sqrt(pow(orbit[i+1].x - orbit[i].x,2) + pow(orbit[i+1].y - orbit[i].y,2));
-    //cout << enu/den << endl;
-    effmass += enu/den;
+    acctype enu = sqrt(pow(orbit.x[i+1] - orbit.x[i],2) + pow(orbit.y[i+1] - orbit.y[i],2));
+    effmass += enu*0.5*(1/acctype(orbit.dE[i]) + 1/acctype(orbit.dE[i+1])); //trapezoidal rule for the line integral of 1/|dE/dk|
   }
   //cout << effmass << endl;
   effmass *= HBAR/ELMASS/ELCHARGE*HBAR/2.0/M_PI*1e20; //1e20 compensates for Angstrom^-2
@@ -95,64 +97,18 @@ fptype OrbitEvaluator::calc_mass(int sliceindex, int orbitindex){
 
 fptype OrbitEvaluator::calc_z(int sliceindex){
   
-  fptype z = sc_length*float(sliceindex)/nslices - sc_length/nsc; 
+  fptype z = grid.kval(sliceindex); //same coordinate the slice was sampled at
   return z;
 }
 
-fptype OrbitEvaluator::get_energy_derivative(OrbitPoint p1, OrbitPoint p2){ //points i and i+1
-  
-  fptype derivative;
-  
-  if(glance_direction_parallel(p1.dir, p2.dir)){
-    derivative = sqrt(pow(p1.dEparallel,2) + pow(p1.dEperpendicular,2));
-  }
-  else{
-    derivative = sqrt(pow(p1.dEparallel,2) + pow(p2.dEparallel,2));
-  }
-  
-  return derivative;
-}
-
-bool OrbitEvaluator::glance_direction_parallel(int d1, int d2){
-  
-  bool parallel = false;
-  
-  if((d1 == 1) && (d2 == 1)){
-    parallel = true;
-  }
-  else if((d1 == 1) && (d2 == 3)){
-    parallel = true;
-  }
-  else if((d1 == 3) && (d2 == 1)){
-    parallel = true;
-  }
-  else if((d1 == 3) && (d2 == 3)){
-    parallel = true;
-  }
-  else if((d1 == 0) && (d2 == 0)){
-    parallel = true;
-  }
-  else if((d1 == 0) && (d2 == 2)){
-    parallel = true;
-  }
-  else if((d1 == 2) && (d2 == 0)){
-    parallel = true;
-  }
-  else if((d1 == 2) && (d2 == 2)){
-    parallel = true;
-  }
-  
-  return parallel;
-}
-
 fptype OrbitEvaluator::calc_center_x(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
 
-  fptype centerx=0;
+  acctype centerx=0;
   for(int i=0;i<npoints;i++){
-    centerx+=orbit[i].x;
+    centerx+=orbit.x[i];
   }
   centerx/=float(npoints);
   
@@ -161,12 +117,12 @@ fptype OrbitEvaluator::calc_center_x(int sliceindex, int orbitindex){
 
 fptype OrbitEvaluator::calc_center_y(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
 
-  fptype centery=0;
+  acctype centery=0;
   for(int i=0;i<npoints;i++){
-    centery+=orbit[i].y;
+    centery+=orbit.y[i];
   }
   centery/=float(npoints);
   
@@ -175,68 +131,56 @@ fptype OrbitEvaluator::calc_center_y(int sliceindex, int orbitindex){
 
 fptype OrbitEvaluator::calc_standarddev_x(int sliceindex, int orbitindex, fptype cx){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
   
-  vector<fptype> xvals;
-  for(int i=0;i<npoints;i++){
-    xvals.push_back(orbit[i].x);
-  }
-  
-  return standarddev(xvals, cx);
+  return standarddev(orbit.x, npoints, cx);
 }
 
 fptype OrbitEvaluator::calc_standarddev_y(int sliceindex, int orbitindex, fptype cy){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   int npoints = orbit.size();
   
-  vector<fptype> yvals;
-  for(int i=0;i<npoints;i++){
-    yvals.push_back(orbit[i].y);
-  }
-  
-  return standarddev(yvals, cy);
+  return standarddev(orbit.y, npoints, cy);
 }
 
 fptype OrbitEvaluator::calc_min_x(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
-  sort(orbit.begin(), orbit.end(), xcomp);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   
-  return orbit[0].x;
+  return *min_element(orbit.x, orbit.x + orbit.size());
 }
 
 fptype OrbitEvaluator::calc_max_x(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
-  sort(orbit.begin(), orbit.end(), xcomp);
-  int nvals = orbit.size();
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   
-  return orbit[nvals-1].x;
+  return *max_element(orbit.x, orbit.x + orbit.size());
 }
 
 fptype OrbitEvaluator::calc_min_y(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
-  sort(orbit.begin(), orbit.end(), ycomp);
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   
-  return orbit[0].y;
+  return *min_element(orbit.y, orbit.y + orbit.size());
 }
 
 fptype OrbitEvaluator::calc_max_y(int sliceindex, int orbitindex){
   
-  vector<OrbitPoint> orbit = con.get_orbit(sliceindex, orbitindex);
-  sort(orbit.begin(), orbit.end(), ycomp);
-  int nvals = orbit.size();
+  OrbitView orbit = con.get_orbit(sliceindex, orbitindex);
   
-  return orbit[nvals-1].y;
+  return *max_element(orbit.y, orbit.y + orbit.size());
 }
 
-fptype standarddev(vector<fptype> values, fptype average){
+fptype standarddev(const vector<fptype>& values, fptype average){
   
-  int nvalues = values.size();
-  fptype variance=0;
+  return standarddev(values.data(), values.size(), average);
+}
+
+fptype standarddev(const fptype* values, int nvalues, fptype average){
+  
+  acctype variance=0;
   
   for(int i=0;i<nvalues;i++){
     variance += pow(average - values[i],2);
@@ -245,29 +189,18 @@ fptype standarddev(vector<fptype> values, fptype average){
   return sqrt(variance);
 }
 
-bool xcomp(OrbitPoint p1, OrbitPoint p2){ 
-  
-  return (p1.x<p2.x); 
-}
-
-bool ycomp(OrbitPoint p1, OrbitPoint p2){ 
-  
-  return (p1.y<p2.y); 
-}
-
 bool fcompaveragedorbit(AveragedOrbit o1, AveragedOrbit o2){
   
   return (o1.f<o2.f);
 }
 
-vector<vector<EvaluatedOrbit> > OrbitEvaluator::get_evaluated_orbits(){
+const vector<vector<EvaluatedOrbit> >& OrbitEvaluator::get_evaluated_orbits(){
   
   return res;
 }
 
-SheetMatcher::SheetMatcher(vector<vector<EvaluatedOrbit> > orbits_in){
+SheetMatcher::SheetMatcher(const vector<vector<EvaluatedOrbit> >& orbits_in) : eorbits(orbits_in){
   
-  eorbits = orbits_in;
   nslices = orbits_in.size();
   
   for(int i=0;i<nslices;i++){
@@ -280,27 +213,50 @@ SheetMatcher::SheetMatcher(vector<vector<EvaluatedOrbit> > orbits_in){
     matched.push_back(temp);
   }
 
-  for(int i=1;i<nslices-1;++i)
-  {
-    for(int j=0;j<norbits[i];++j)
-    {
-      if(!matched[i][j])
-      {
-        find_sheet(i,j);
+  //seeds are taken in the serial order, the candidates of a batch of unmatched seeds are scored in parallel and
+  //assigned afterwards seed by seed, so the sheets do not depend on the number of threads
+  vector<pair<int,int> > seeds;
+  for(int i=1;i<nslices-1;i++){
+    for(int j=0;j<norbits[i];j++){
+      seeds.push_back(make_pair(i, j));
+    }
+  }
+  
+  int nseeds = seeds.size(), batchsize = 4*omp_get_max_threads();
+  int next = 0;
+  vector<pair<int,int> > batch;
+  vector<vector<PossibleMatch> > candidates;
+  while(next < nseeds){
+    batch.clear();
+    for(;(next < nseeds) && (int(batch.size()) < batchsize);next++){
+      if(!matched[seeds[next].first][seeds[next].second]){
+	batch.push_back(seeds[next]);
+      }
+    }
+    
+    int nbatch = batch.size();
+    candidates.resize(nbatch);
+    #pragma omp parallel for schedule(dynamic)
+    for(int b=0;b<nbatch;b++){
+      candidates[b] = find_candidates(batch[b].first, batch[b].second);
+    }
+    
+    for(int b=0;b<nbatch;b++){
+      if(!matched[batch[b].first][batch[b].second]){ //an earlier seed of this batch may have taken it
+	assign_sheet(batch[b].first, batch[b].second, candidates[b]);
       }
     }
   }
 }
 
-void SheetMatcher::find_sheet(int sliceindex, int orbitindex){
-  
-  vector<EvaluatedOrbit> sh;
-  sh.push_back(eorbits[sliceindex][orbitindex]);
+vector<PossibleMatch> SheetMatcher::find_candidates(int sliceindex, int orbitindex){
   
+  //all orbits of the following slices that fulfill the matching condition, sorted by slice and matching parameter
+  vector<PossibleMatch> candidates;
   for(int i=sliceindex+1;i<nslices;i++){
     vector<PossibleMatch> pm;
     for(int j=0;j<norbits[i];j++){
-      if(simple_matching_condition_fulfilled(sliceindex, orbitindex, i, j) && (!(matched[i][j]))){
+      if(simple_matching_condition_fulfilled(sliceindex, orbitindex, i, j)){
 	PossibleMatch m;
 	m.o = eorbits[i][j];
 	m.i = i;
@@ -308,15 +264,28 @@ void SheetMatcher::find_sheet(int sliceindex, int orbitindex){
 	pm.push_back(m);
       }
     }
-    int nfoundorbits = pm.size();
-    if(nfoundorbits == 1){
-      sh.push_back(pm[0].o);
-      matched[pm[0].i][pm[0].j] = true;
-    }
-    else if(nfoundorbits > 1){
-      PossibleMatch bestmatch = get_best_match(eorbits[sliceindex][orbitindex], pm);
-      sh.push_back(bestmatch.o);
-      matched[bestmatch.i][bestmatch.j] = true;
+    pm = calc_matching_parameter(eorbits[sliceindex][orbitindex], pm);
+    stable_sort(pm.begin(), pm.end(), Bcomp);
+    candidates.insert(candidates.end(), pm.begin(), pm.end());
+  }
+  
+  return candidates;
+}
+
+void SheetMatcher::assign_sheet(int sliceindex, int orbitindex, const vector<PossibleMatch>& candidates){
+  
+  //on every slice the unmatched candidate with the lowest matching parameter joins the sheet
+  vector<EvaluatedOrbit> sh;
+  sh.push_back(eorbits[sliceindex][orbitindex]);
+  
+  int ncandidates = candidates.size();
+  int lastslice = -1;
+  for(int n=0;n<ncandidates;n++){
+    const PossibleMatch& m = candidates[n];
+    if((m.i != lastslice) && !matched[m.i][m.j]){
+      sh.push_back(m.o);
+      matched[m.i][m.j] = true;
+      lastslice = m.i;
     }
   }
   
@@ -343,17 +312,7 @@ bool SheetMatcher::simple_matching_condition_fulfilled(int i1, int j1, int i2, i
   return (sdevc && sdevmax && sdevmin);
 }
 
-PossibleMatch SheetMatcher::get_best_match(EvaluatedOrbit orbit1, vector<PossibleMatch> pm){
-  
-  vector<PossibleMatch> npm;
-  npm = calc_matching_parameter(orbit1, pm);
-  
-  sort(npm.begin(), npm.end(), Bcomp);
-  
-  return npm[0]; //return value with lowest B-value
-}
-
-vector<PossibleMatch> SheetMatcher::calc_matching_parameter(EvaluatedOrbit orbit1, vector<PossibleMatch> pm){
+vector<PossibleMatch> SheetMatcher::calc_matching_parameter(const EvaluatedOrbit& orbit1, const vector<PossibleMatch>& pm){
   
   vector<PossibleMatch> npm;
   
@@ -370,7 +329,7 @@ vector<PossibleMatch> SheetMatcher::calc_matching_parameter(EvaluatedOrbit orbit
   return npm;
 }
 
-vector<vector<EvaluatedOrbit> > SheetMatcher::get_sheets(){
+const vector<vector<EvaluatedOrbit> >& SheetMatcher::get_sheets(){
   
   return sheets;
 }
@@ -385,9 +344,8 @@ bool fcomp(ExtremalOrbitInRUC o1, ExtremalOrbitInRUC o2){
   return (o1.f<o2.f); 
 }
 
-FrequencyCalculator::FrequencyCalculator(GlobalSettings& settings, vector<vector<EvaluatedOrbit> > sheets_in, boost::multi_array<fptype, 2> hruc_in){
+FrequencyCalculator::FrequencyCalculator(GlobalSettings& settings, const vector<vector<EvaluatedOrbit> >& sheets_in, const boost::multi_array<fptype, 2>& hruc_in) : sheets(sheets_in){
   
-  sheets = sheets_in;
   nsheets = sheets.size();
   minimumfreq = settings.minimumfreq;
   
@@ -599,7 +557,7 @@ void FrequencyCalculator::average_properties(){
   sort(averagevec.begin(), averagevec.end(), fcompaveragedorbit);
 }
 
-vector<AveragedOrbit> FrequencyCalculator::get_properties(){
+const vector<AveragedOrbit>& FrequencyCalculator::get_properties(){
   
   return averagevec;
 }
@@ -607,7 +565,7 @@ vector<AveragedOrbit> FrequencyCalculator::get_properties(){
 fptype average(vector<fptype> values){
   
   int nentries = values.size();
-  fptype val = 0;
+  acctype val = 0;
   for(int i=0;i<nentries;i++){
     val += values[i];
   }
@@ -20,6 +20,8 @@
 //eval.hpp
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <omp.h>
 
 #include "orbit.hpp"
 #include "typedefs.hpp"
@@ -45,16 +47,14 @@ struct EvaluatedOrbit{
 class OrbitEvaluator{
   
   public:
-    OrbitEvaluator(OrbitContainer* orbits, fptype sc_length_in, fptype nsc_in);
-    vector<vector<EvaluatedOrbit> > get_evaluated_orbits();
+    OrbitEvaluator(const OrbitContainer& orbits, const SuperCellGrid& grid_in);
+    const vector<vector<EvaluatedOrbit> >& get_evaluated_orbits();
   private:
     void calc_all();
-    fptype sc_length, nsc;
+    SuperCellGrid grid;
     fptype calc_frequency(int sliceindex, int orbitindex);
     fptype calc_mass(int sliceindex, int orbitindex);
     fptype calc_z(int sliceindex);
-    fptype get_energy_derivative(OrbitPoint p1, OrbitPoint p2);
-    bool glance_direction_parallel(int d1, int d2);
     fptype calc_center_x(int sliceindex, int orbitindex);
     fptype calc_center_y(int sliceindex, int orbitindex);
     fptype calc_standarddev_x(int sliceindex, int orbitindex, fptype cx);
@@ -63,7 +63,7 @@ class OrbitEvaluator{
     fptype calc_max_x(int sliceindex, int orbitindex);
     fptype calc_min_y(int sliceindex, int orbitindex);
     fptype calc_max_y(int sliceindex, int orbitindex);
-    OrbitContainer con;
+    const OrbitContainer& con; //the orbit finder must outlive the evaluator
     int nslices;
     vector<int> norbits;
     vector<vector<EvaluatedOrbit> > res;
@@ -80,14 +80,14 @@ struct PossibleMatch{
 class SheetMatcher{
   
   public:
-    SheetMatcher(vector<vector<EvaluatedOrbit> > orbits_in);
-    vector<vector<EvaluatedOrbit> > get_sheets();
+    SheetMatcher(const vector<vector<EvaluatedOrbit> >& orbits_in);
+    const vector<vector<EvaluatedOrbit> >& get_sheets();
   private:
-    void find_sheet(int sliceindex, int orbitindex);
+    vector<PossibleMatch> find_candidates(int sliceindex, int orbitindex);
+    void assign_sheet(int sliceindex, int orbitindex, const vector<PossibleMatch>& candidates);
     bool simple_matching_condition_fulfilled(int i1, int j1, int i2, int j2);
-    PossibleMatch get_best_match(EvaluatedOrbit orbit1, vector<PossibleMatch> pm);
-    vector<PossibleMatch> calc_matching_parameter(EvaluatedOrbit orbit1, vector<PossibleMatch> pm);
-    vector<vector<EvaluatedOrbit> > eorbits;
+    vector<PossibleMatch> calc_matching_parameter(const EvaluatedOrbit& orbit1, const vector<PossibleMatch>& pm);
+    const vector<vector<EvaluatedOrbit> >& eorbits; //the evaluator must outlive the matcher
     int nslices;
     vector<int> norbits;
     vector<vector<bool> > matched;
@@ -121,8 +121,8 @@ struct AveragedOrbit{
 class FrequencyCalculator{
   
   public:
-    FrequencyCalculator(GlobalSettings& settings, vector<vector<EvaluatedOrbit> > sheets_in, boost::multi_array<fptype, 2> hruc_in);
-    vector<AveragedOrbit> get_properties();
+    FrequencyCalculator(GlobalSettings& settings, const vector<vector<EvaluatedOrbit> >& sheets_in, const boost::multi_array<fptype, 2>& hruc_in);
+    const vector<AveragedOrbit>& get_properties();
   private:
     bool orbit_extremal(int sheetindex, int orbitindex);
     bool within_kdistance(int i1, int i2);
@@ -135,7 +135,7 @@ class FrequencyCalculator{
     fptype maxkdiff;
     fptype maxfreqdiff;
     vector<int> norbits;
-    vector<vector<EvaluatedOrbit> > sheets;
+    const vector<vector<EvaluatedOrbit> >& sheets; //the matcher must outlive the calculator
     vector<EvaluatedOrbit> extremalorbits;
     vector<ExtremalOrbitInRUC> rucorbits;
     vector<vector<ExtremalOrbitInRUC> > grouped_orbits;
@@ -146,9 +146,8 @@ class FrequencyCalculator{
 #endif
 
 fptype average(vector<fptype> values);
-fptype standarddev(vector<fptype> values, fptype average);
-bool xcomp(OrbitPoint p1, OrbitPoint p2);
-bool ycomp(OrbitPoint p1, OrbitPoint p2);
+fptype standarddev(const vector<fptype>& values, fptype average);
+fptype standarddev(const fptype* values, int nvalues, fptype average);
 bool Bcomp(PossibleMatch o1, PossibleMatch o2);
 bool fcomp(ExtremalOrbitInRUC o1, ExtremalOrbitInRUC o2);
 bool fcompaveragedorbit(AveragedOrbit o1, AveragedOrbit o2);
@@ -0,0 +1,109 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//fft.cpp
+#include "fft.hpp"
+
+FourierTransform::FourierTransform(int n_in){
+  
+  n = n_in;
+  bool poweroftwo = ((n & (n-1)) == 0);
+  m = 1;
+  while(m < (poweroftwo ? n : 2*n-1)){
+    m <<= 1;
+  }
+  
+  twiddles.resize(m/2);
+  for(int k=0;k<m/2;k++){
+    twiddles[k] = polar(1.0, -2*M_PI*k/m);
+  }
+  
+  if(!poweroftwo){
+    //jk = (j^2 + k^2 - (k-j)^2)/2 turns the transform into a convolution with the chirp
+    chirp.resize(n);
+    for(long k=0;k<n;k++){
+      chirp[k] = polar(1.0, -M_PI*double((k*k) % (2*n))/n); //the reduction keeps the phase accurate for large k
+    }
+    kernel.assign(m, cplx(0, 0));
+    kernel[0] = conj(chirp[0]);
+    for(int k=1;k<n;k++){
+      kernel[k] = kernel[m-k] = conj(chirp[k]);
+    }
+    radix2(kernel, false);
+  }
+}
+
+void FourierTransform::forward(vector<cplx>& a) const{
+  
+  transform(a, false);
+}
+
+void FourierTransform::inverse(vector<cplx>& a) const{
+  
+  transform(a, true);
+}
+
+void FourierTransform::transform(vector<cplx>& a, bool inv) const{
+  
+  if(m == n){
+    radix2(a, inv);
+    return;
+  }
+  
+  //the inverse transform is the conjugate of the forward transform of the conjugate
+  vector<cplx> b(m, cplx(0, 0));
+  for(int k=0;k<n;k++){
+    b[k] = (inv ? conj(a[k]) : a[k]) * chirp[k];
+  }
+  radix2(b, false);
+  for(int k=0;k<m;k++){
+    b[k] *= kernel[k];
+  }
+  radix2(b, true);
+  for(int k=0;k<n;k++){
+    cplx result = b[k] * chirp[k] / double(m);
+    a[k] = inv ? conj(result) : result;
+  }
+}
+
+void FourierTransform::radix2(vector<cplx>& a, bool inv) const{
+  
+  for(int i=1, j=0;i<m;i++){ //bit reversed order
+    int bit = m >> 1;
+    for(;j & bit;bit >>= 1){
+      j ^= bit;
+    }
+    j ^= bit;
+    if(i < j){
+      swap(a[i], a[j]);
+    }
+  }
+  
+  for(int len=2;len<=m;len<<=1){
+    int stride = m/len;
+    for(int i=0;i<m;i+=len){
+      for(int k=0;k<len/2;k++){
+	cplx w = inv ? conj(twiddles[k*stride]) : twiddles[k*stride];
+	cplx u = a[i+k], v = a[i+k+len/2] * w;
+	a[i+k] = u + v;
+	a[i+k+len/2] = u - v;
+      }
+    }
+  }
+}
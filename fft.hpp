@@ -0,0 +1,49 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//fft.hpp
+#include <vector>
+#include <complex>
+#include <cmath>
+
+using namespace std;
+
+#ifndef FOURIER_TRANSFORM_H
+#define FOURIER_TRANSFORM_H
+
+typedef complex<double> cplx;
+
+class FourierTransform{ //unnormalized discrete Fourier transform of one fixed length
+  //powers of two use an iterative radix-2 transform, all other lengths are mapped onto one by Bluestein's algorithm
+  public:
+    FourierTransform(int n_in);
+    int size() const {return n;}
+    void forward(vector<cplx>& a) const; //a_k = sum_j a_j exp(-2 pi i jk/n)
+    void inverse(vector<cplx>& a) const; //a_j = sum_k a_k exp(+2 pi i jk/n), without the factor 1/n
+  private:
+    int n;
+    int m; //length of the radix-2 transforms, n itself or the power of two Bluestein's convolution is carried out with
+    vector<cplx> twiddles; //exp(-2 pi i k/m) for k < m/2
+    vector<cplx> chirp; //exp(-pi i k^2/n) for k < n, only for Bluestein's algorithm
+    vector<cplx> kernel; //transformed conjugate chirp, only for Bluestein's algorithm
+    void radix2(vector<cplx>& a, bool inv) const;
+    void transform(vector<cplx>& a, bool inv) const;
+};
+
+#endif
@@ -20,120 +20,834 @@
 //files.cpp
 #include "files.hpp"
 
+static const char cachemagic[8] = {'D', 'H', 'V', 'A', 'B', 'B', 'G', '1'};
+static const char sweepmagic[8] = {'D', 'H', 'V', 'A', 'S', 'W', 'P', '1'};
+static const char occupancymagic[8] = {'D', 'H', 'V', 'A', 'O', 'C', 'C', '1'};
+
+// Functions for BandGrid class
+
+BandGrid::BandGrid(){
+  
+  h.resize(boost::extents[3][3]);
+  nbands = 0;
+  fermi = 0;
+  energydata = NULL;
+}
+
+bool BandGrid::read_cache(boost::filesystem::path cachepath, bool checkunits){
+  
+  //the energies in the cache are used in place, the mapping is kept open for the lifetime of this object
+  if(!BOOST_ENDIAN_LITTLE_BYTE){
+    printf("Error: Binary band grid caches are only supported on little-endian machines.\n");
+    return false;
+  }
+  
+  BandGridCacheHeader header;
+  if(boost::filesystem::file_size(cachepath) < sizeof(header)){ //also keeps empty files, which cannot be mapped, away from the mapping
+    printf("Error: Binary band grid cache %s is truncated.\n", cachepath.string().c_str());
+    return false;
+  }
+  try{
+    mappedcache.open(cachepath.string());
+  }
+  catch(const ios_base::failure& e){
+    printf("Error: Binary band grid cache %s could not be mapped: %s\n", cachepath.string().c_str(), e.what());
+    return false;
+  }
+  const char* begin = mappedcache.data();
+  memcpy(&header, begin, sizeof(header));
+  
+  //the header of a stale or truncated cache must not lead to reads outside of the mapping
+  bool valid = (memcmp(header.magic, cachemagic, sizeof(cachemagic)) == 0) && (header.nbands >= 0)
+               && (header.nkpoints[0] > 0) && (header.nkpoints[1] > 0) && (header.nkpoints[2] > 0);
+  long headerbytes = sizeof(header) + long(header.nbands)*(sizeof(int32_t) + 2*sizeof(float));
+  double filebytes = double(header.dataoffset) + double(header.nbands)*header.nkpoints[0]*header.nkpoints[1]*header.nkpoints[2]*sizeof(float); //cannot overflow
+  valid = valid && (header.dataoffset >= headerbytes) && (header.dataoffset % 64 == 0) && (filebytes == double(mappedcache.size())); //the energies are used in place and must stay aligned
+  long nvalues = long(header.nkpoints[0]) * header.nkpoints[1] * header.nkpoints[2];
+  if(!valid){
+    printf("Error: Binary band grid cache %s is truncated or corrupt.\n", cachepath.string().c_str());
+    mappedcache.close();
+    return false;
+  }
+  if(checkunits && (header.inputinev != inputinev)){
+    printf("Warning: Binary band grid cache %s was created with different input units and is ignored.\n", cachepath.string().c_str());
+    mappedcache.close();
+    return false;
+  }
+  
+  inputinev = header.inputinev;
+  fermi = header.fermi;
+  nbands = header.nbands;
+  for(int i=0;i<3;i++){
+    nkpoints[i] = header.nkpoints[i];
+    for(int j=0;j<3;j++){
+      h[i][j] = header.h[3*i+j];
+    }
+  }
+  
+  const char* p = begin + sizeof(header);
+  vector<int32_t> numbers(nbands);
+  emin.resize(nbands);
+  emax.resize(nbands);
+  memcpy(numbers.data(), p, nbands*sizeof(int32_t));
+  p += nbands*sizeof(int32_t);
+  memcpy(emin.data(), p, nbands*sizeof(float));
+  p += nbands*sizeof(float);
+  memcpy(emax.data(), p, nbands*sizeof(float));
+  bandnumbers.assign(numbers.begin(), numbers.end());
+  
+  const float* data = reinterpret_cast<const float*>(begin + header.dataoffset);
+  if(is_same<fptype, float>::value){
+    energydata = reinterpret_cast<const fptype*>(data);
+  }
+  else{ //other precisions need one conversion
+    energies.resize(boost::extents[nbands][nkpoints[0]][nkpoints[1]][nkpoints[2]]);
+    copy(data, data + nbands*nvalues, energies.data());
+    energydata = energies.data();
+  }
+  
+  return true;
+}
+
+void BandGrid::write_cache(boost::filesystem::path cachepath){
+  
+  BandGridCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, cachemagic, sizeof(cachemagic));
+  int32_t headerbytes = sizeof(header) + nbands*(sizeof(int32_t) + 2*sizeof(float));
+  header.dataoffset = (headerbytes + 63)/64*64; //energies are aligned to cache lines
+  header.inputinev = inputinev;
+  header.nbands = nbands;
+  header.fermi = fermi;
+  for(int i=0;i<3;i++){
+    header.nkpoints[i] = nkpoints[i];
+    for(int j=0;j<3;j++){
+      header.h[3*i+j] = h[i][j];
+    }
+  }
+  
+  vector<int32_t> numbers(bandnumbers.begin(), bandnumbers.end());
+  vector<float> lower(emin.begin(), emin.end()), upper(emax.begin(), emax.end());
+  vector<char> padding(header.dataoffset - headerbytes, 0);
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  
+  boost::filesystem::ofstream filehandle(cachepath, ios::out | ios::binary);
+  filehandle.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  filehandle.write(reinterpret_cast<const char*>(numbers.data()), nbands*sizeof(int32_t));
+  filehandle.write(reinterpret_cast<const char*>(lower.data()), nbands*sizeof(float));
+  filehandle.write(reinterpret_cast<const char*>(upper.data()), nbands*sizeof(float));
+  filehandle.write(padding.data(), padding.size());
+  if(is_same<fptype, float>::value){ //written straight from the grid
+    filehandle.write(reinterpret_cast<const char*>(energydata), nbands*nvalues*sizeof(float));
+  }
+  else{ //other precisions are converted one band at a time
+    vector<float> band(nvalues);
+    for(int b=0;b<nbands;b++){
+      copy(energydata + b*nvalues, energydata + (b+1)*nvalues, band.begin());
+      filehandle.write(reinterpret_cast<const char*>(band.data()), nvalues*sizeof(float));
+    }
+  }
+  filehandle.close();
+}
+
+void BandGrid::calc_band_range(int bandindex){
+  
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  const fptype* data = energies[bandindex].origin();
+  emin.push_back(*min_element(data, data + nvalues));
+  emax.push_back(*max_element(data, data + nvalues));
+}
+
+void BandGrid::discard_bands(){
+  
+  //none of the bands of a corrupt or incomplete input file can be trusted, the program continues without bands
+  nbands = 0;
+  bandnumbers.clear();
+  emin.clear();
+  emax.clear();
+  energydata = NULL;
+}
+
+boost::array<int, 3> BandGrid::get_nkpoints(){
+  
+  return nkpoints;
+}
+
+boost::multi_array<fptype, 2> BandGrid::get_h(){
+  
+  return h;
+}
+
+int BandGrid::get_bandcount(){
+  
+  return nbands;
+}
+
+int BandGrid::get_bandnumber(int bandindex){
+  
+  return bandnumbers[bandindex];
+}
+
+bool BandGrid::band_crosses_fermi(int bandindex){
+  
+  return ((emin[bandindex] <= 0) && (emax[bandindex] >= 0));
+}
+
+vector<fptype> BandGrid::get_energies_list(int bandindex){
+  
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  return vector<fptype>(energydata + bandindex*nvalues, energydata + (bandindex+1)*nvalues);
+}
+
+boost::multi_array<fptype, 3> BandGrid::get_energies(int bandindex){
+  
+  return get_energies_ref(bandindex);
+}
+
+boost::const_multi_array_ref<fptype, 3> BandGrid::get_energies_ref(int bandindex){ //non-owning view, valid as long as this object exists
+  
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  return boost::const_multi_array_ref<fptype, 3>(energydata + bandindex*nvalues, boost::extents[nkpoints[0]][nkpoints[1]][nkpoints[2]]);
+}
+
 // Functions for bxsf class
 
 bxsf::bxsf(boost::filesystem::path path, int inputinev_in){
   
   inputinev = inputinev_in;
-  h.resize(boost::extents[3][3]); 
   filepath = path;
-  read();
+  
+  if(is_cache_file(filepath)){
+    read_cache(filepath, false); //energies in a cache are always stored in eV
+  }
+  else{
+    boost::filesystem::path cachepath = get_cache_path(filepath); //use an up-to-date cache next to the text file if there is one
+    bool cached = boost::filesystem::exists(cachepath) 
+                  && (boost::filesystem::last_write_time(cachepath) >= boost::filesystem::last_write_time(filepath));
+    if(cached && !read_cache(cachepath, true)){
+      printf("Parsing %s instead.\n", filepath.string().c_str());
+      cached = false;
+    }
+    if(!cached){
+      Compression compression = detect_compression(filepath);
+      if(compression == COMPRESSION_NONE){
+        read();
+      }
+      else{
+        read_compressed(compression);
+      }
+    }
+  }
 }
 
 void bxsf::read(){
   
-  int BANDNUMBER_PASSED = 0;
-  int END_BANDGRID_3D_PASSED = 0;
+  //the file is mapped into memory and scanned in place, energies are written directly into the final grid
+  boost::iostreams::mapped_file_source mappedfile(filepath.string());
+  const char* begin = mappedfile.data();
+  const char* end = begin + mappedfile.size();
+  string_view content(begin, mappedfile.size());
   
-  boost::filesystem::ifstream filehandle(filepath);
-  string line;
-  while(getline(filehandle, line)){
-    if(line.find("Fermi Energy:") != string::npos){
-      vector<string> linestr;
-      line = trim_all(line); //erase trailing and leading spaces, reduce intermediate spaces to one space
-      boost::split(linestr, line, boost::is_any_of("\t "));
-      fermi = boost::lexical_cast<fptype>(linestr[2]);
+  size_t pos = content.find("Fermi Energy:");
+  if(pos != string_view::npos){
+    parse_value(begin + pos + strlen("Fermi Energy:"), end, fermi);
+  }
+  
+  nbands = 0;
+  pos = content.find("BANDGRID_3D_BANDS");
+  if(pos != string_view::npos){
+    const char* p = begin + pos + strlen("BANDGRID_3D_BANDS");
+    fptype origin, value;
+    p = parse_value(p, end, nbands);
+    for(int i=0;i<3;i++){
+      p = parse_value(p, end, nkpoints[i]);
+    }
+    for(int i=0;i<3;i++){
+      p = parse_value(p, end, origin); //grid origin
     }
+    for(int j=0;j<3;j++){
+      for(int i=0;i<3;i++){
+	p = parse_value(p, end, value);
+	h[j][i] = 2*M_PI*INVBOHR2INVANGSTROM*value; //reciprocal lattice vectors are given in bohr^-1 and without 2PI prefactor
+      }
+    }
+  }
+  
+  energies.resize(boost::extents[nbands][nkpoints[0]][nkpoints[1]][nkpoints[2]]); //holds energies of all bands on the k-point grid
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  
+  //all bands are collected in one pass, each band block ends at the next BAND: or at END_BANDGRID_3D
+  int nfound = 0;
+  pos = content.find("BAND:", pos);
+  while((pos != string_view::npos) && (nfound < nbands)){
+    int bandnumber = 0;
+    const char* p = parse_value(begin + pos + strlen("BAND:"), end, bandnumber);
+    pos = min(content.find("BAND:", p - begin), content.find("END_BANDGRID_3D", p - begin));
+    const char* q = (pos == string_view::npos) ? end : begin + pos;
     
-    if(line.find("BANDGRID_3D_BANDS") != string::npos){
-      vector<string> linestr;
-      getline(filehandle, line); //skip useless line
-      getline(filehandle, line); //this line contains nkpoints
-      line = trim_all(line);
-      boost::split(linestr, line, boost::is_any_of("\t "));
+    fptype* dest = energies[nfound].origin();
+    if(nvalues != parse_energies(p, q, dest, nvalues)){
+      printf("Error: Number of energy values does not match gridsize in band %i.\n", bandnumber);
+    }
+    bandnumbers.push_back(bandnumber);
+    calc_band_range(nfound);
+    nfound++;
+    
+    if((pos != string_view::npos) && (content.compare(pos, strlen("BAND:"), "BAND:") != 0)){
+      break; //reached END_BANDGRID_3D
+    }
+  }
+  
+  if(nfound != nbands){
+    printf("Error: Found %i bands, but header specifies %i bands.\n", nfound, nbands);
+    nbands = nfound;
+  }
+  energydata = energies.data();
+}
+
+void bxsf::read_compressed(Compression compression){
+  
+  //the file is decompressed as a stream and tokenized block by block, so the decompressed text is never held in full
+  boost::filesystem::ifstream filehandle(filepath, ios::in | ios::binary);
+  boost::iostreams::filtering_istream in;
+  push_decompressor(in, compression);
+  in.push(filehandle);
+  in.exceptions(ios::badbit); //errors of the decompressor are otherwise swallowed and look like the end of the file
+  
+  BandGridStreamState state;
+  state.nheadervalues = -1;
+  state.bandindex = -1;
+  state.nread = 0;
+  state.finished = false;
+  nbands = 0;
+  
+  try{
+    read_lines(in, [&](string_view line){ parse_stream_line(line, state); });
+  }
+  catch(const ios_base::failure& e){
+    printf("Error: Input file %s could not be decompressed: %s\n", filepath.string().c_str(), e.what());
+    discard_bands();
+    return;
+  }
+  
+  if(!state.finished){ //some decompressors end a truncated stream without an error
+    printf("Error: Input file %s is truncated, END_BANDGRID_3D is missing.\n", filepath.string().c_str());
+    discard_bands();
+    return;
+  }
+  nbands = bandnumbers.size();
+  energydata = energies.data();
+}
+
+void bxsf::parse_stream_line(string_view line, BandGridStreamState& state){
+  
+  if(state.finished){
+    return;
+  }
+  
+  const char* p = line.data();
+  const char* end = p + line.size();
+  
+  if(line.find("END_BANDGRID_3D") != string_view::npos){
+    finish_stream_band(state);
+    state.finished = true;
+  }
+  else if(line.find("BAND:") != string_view::npos){
+    finish_stream_band(state);
+    int bandnumber = 0;
+    parse_value(p + line.find("BAND:") + strlen("BAND:"), end, bandnumber);
+    if(state.bandindex < 0){ //allocate all bands once the header is known
+      energies.resize(boost::extents[nbands][nkpoints[0]][nkpoints[1]][nkpoints[2]]);
+    }
+    state.bandindex++;
+    state.nread = 0;
+    if(state.bandindex < nbands){
+      bandnumbers.push_back(bandnumber);
+    }
+    else{
+      printf("Error: Found more bands than the header specifies.\n");
+      state.finished = true;
+    }
+  }
+  else if(line.find("Fermi Energy:") != string_view::npos){
+    parse_value(p + line.find("Fermi Energy:") + strlen("Fermi Energy:"), end, fermi);
+  }
+  else if(line.find("BANDGRID_3D_BANDS") != string_view::npos){
+    state.nheadervalues = 0;
+  }
+  else if((state.nheadervalues >= 0) && (state.nheadervalues < 16)){
+    p = skip_whitespace(p, end);
+    while((p < end) && (state.nheadervalues < 16)){
+      p = skip_whitespace(parse_value(p, end, state.headervalues[state.nheadervalues++]), end);
+    }
+    if(state.nheadervalues == 16){
+      nbands = int(state.headervalues[0]);
       for(int i=0;i<3;i++){
-	nkpoints[i] = boost::lexical_cast<int>(linestr[i]);
+	nkpoints[i] = int(state.headervalues[1+i]);
       }
-      getline(filehandle, line); //grid origin line
       for(int j=0;j<3;j++){
-        getline(filehandle, line); //lines of the reciprocal unit cell matrix
-        line = trim_all(line);
-        boost::split(linestr, line, boost::is_any_of("\t "));
-        for(int i=0;i<3;i++){
-	  h[j][i] = 2*M_PI*INVBOHR2INVANGSTROM*boost::lexical_cast<fptype>(linestr[i]); //reciprocal lattice vectors are given in bohr^-1 and without 2PI prefactor
-        }
+	for(int i=0;i<3;i++){
+	  h[j][i] = 2*M_PI*INVBOHR2INVANGSTROM*fptype(state.headervalues[7+3*j+i]); //reciprocal lattice vectors are given in bohr^-1 and without 2PI prefactor
+	}
       }
     }
-    
-    if(line.find("BAND:") != string::npos){
-      vector<string> linestr;
-      line = trim_all(line);
-      boost::split(linestr, line, boost::is_any_of("\t "));
-      bandnumber = boost::lexical_cast<int>(linestr[1]);
-      BANDNUMBER_PASSED = 1;
+  }
+  else if(state.bandindex >= 0){
+    const fptype scale = inputinev ? 1.0 : RYDBERG2EV;
+    long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+    fptype* dest = energies[state.bandindex].origin();
+    p = skip_whitespace(p, end);
+    while(p < end){
+      fptype value = 0;
+      const char* q = parse_value(p, end, value);
+      if(q == p){
+	printf("Error: Energy value could not be parsed.\n");
+	q = skip_token(p, end);
+      }
+      if(state.nread < nvalues){
+	dest[state.nread] = (value - fermi) * scale; //fermi energy is substracted
+      }
+      state.nread++;
+      p = skip_whitespace(q, end);
     }
-    
-    if(line.find("END_BANDGRID_3D") != string::npos){
-      END_BANDGRID_3D_PASSED = 1;
+  }
+}
+
+void bxsf::finish_stream_band(BandGridStreamState& state){
+  
+  if((state.bandindex < 0) || (state.bandindex >= nbands) || (int(emin.size()) > state.bandindex)){
+    return;
+  }
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  if(state.nread != nvalues){
+    printf("Error: Number of energy values does not match gridsize in band %i.\n", bandnumbers[state.bandindex]);
+  }
+  calc_band_range(state.bandindex);
+}
+
+long bxsf::parse_energies(const char* begin, const char* end, fptype* dest, long nvalues){
+  
+  //split the text into chunks at token boundaries, count the tokens per chunk and then parse all chunks in parallel
+  const long chunksize = 1 << 20;
+  vector<const char*> bounds;
+  bounds.push_back(begin);
+  while(end - bounds.back() > chunksize){
+    bounds.push_back(skip_token(bounds.back() + chunksize, end));
+  }
+  bounds.push_back(end);
+  int nchunks = bounds.size() - 1;
+  
+  vector<long> offsets(nchunks + 1, 0);
+  #pragma omp parallel for schedule(dynamic)
+  for(int c=0;c<nchunks;c++){
+    offsets[c+1] = count_tokens(bounds[c], bounds[c+1]);
+  }
+  for(int c=0;c<nchunks;c++){
+    offsets[c+1] += offsets[c];
+  }
+  if(offsets[nchunks] != nvalues){
+    return offsets[nchunks];
+  }
+  
+  const fptype scale = inputinev ? 1.0 : RYDBERG2EV;
+  long nerrors = 0;
+  #pragma omp parallel for schedule(dynamic) reduction(+:nerrors)
+  for(int c=0;c<nchunks;c++){
+    const char* p = skip_whitespace(bounds[c], bounds[c+1]);
+    for(long n=offsets[c];n<offsets[c+1];n++){
+      fptype value = 0;
+      const char* q = parse_value(p, bounds[c+1], value);
+      if(q == p){
+	nerrors++;
+	q = skip_token(p, bounds[c+1]);
+      }
+      dest[n] = (value - fermi) * scale; //fermi energy is substracted
+      p = skip_whitespace(q, bounds[c+1]);
     }
-    
-    if((1 == BANDNUMBER_PASSED) && (0 == END_BANDGRID_3D_PASSED) && (line.find("BAND:") == string::npos)){
+  }
+  if(nerrors > 0){
+    printf("Error: %li energy values could not be parsed.\n", nerrors);
+  }
+  
+  return offsets[nchunks];
+}
+
+// Functions for bandkp class
+
+bandkp::bandkp(boost::filesystem::path dotinpath, boost::filesystem::path bandkppath, const boost::array<int, 3>& nkpoints_in){
+  
+  nkpoints = nkpoints_in;
+  inputinev = 1; //FPLO energies are given in eV relative to the fermi energy
+  fermi = 0;
+  nread = 0;
+  read_lattice(dotinpath);
+  read_energies(bandkppath);
+}
+
+void bandkp::read_lattice(boost::filesystem::path dotinpath){
+  
+  const double angstroem2bohr = 1.88972612457;
+  Eigen::Vector3d lengths(0, 0, 0), angles(90, 90, 90);
+  bool angstroem = false;
+  
+  boost::filesystem::ifstream filehandle(dotinpath);
+  string line;
+  while(getline(filehandle, line)){
+    bool islengths = (line.find("real lattice_constants[3]={") != string::npos);
+    bool isangles = (line.find("real axis_angles[3]={") != string::npos);
+    if(islengths || isangles){
       vector<string> linestr;
-      line = trim_all(line);
-      boost::split(linestr, line, boost::is_any_of("\t "));
-      for(int i=0;i<int(linestr.size());i++){
-	energies_list.push_back(boost::lexical_cast<fptype>(linestr[i]) - fermi); //fermi energy is substracted
+      string values = line.substr(line.find("{") + 1, line.find("}") - line.find("{") - 1);
+      boost::split(linestr, values, boost::is_any_of(","));
+      for(int i=0;(i<3) && (i<int(linestr.size()));i++){
+	double value = boost::lexical_cast<double>(boost::trim_copy(linestr[i]));
+	if(islengths){
+	  lengths(i) = value;
+	}
+	else{
+	  angles(i) = value*M_PI/180.0;
+	}
       }
     }
+    if(line.find("Angstroem") != string::npos){
+      angstroem = true;
+    }
   }
   filehandle.close();
   
-  energies.resize(boost::extents[nkpoints[0]][nkpoints[1]][nkpoints[2]]); //holds energies on the k-point grid
+  if(angstroem){
+    lengths *= angstroem2bohr;
+  }
+  
+  //construct direct lattice vectors as columns, then the reciprocal lattice vectors in bohr^-1 including the 2PI prefactor
+  double a = lengths(0), b = lengths(1), c = lengths(2);
+  double b3 = cos(angles(0))*b;
+  double b2 = sqrt(b*b - b3*b3);
+  double a3 = cos(angles(1))*a;
+  double a2 = (a*b*cos(angles(2)) - a3*b3)/b2;
+  double a1 = sqrt(a*a - a2*a2 - a3*a3);
+  
+  Eigen::Matrix3d direct, reciprocal;
+  direct << a1, 0, 0,
+            a2, b2, 0,
+            a3, b3, c;
+  double volume = direct.col(0).dot(direct.col(1).cross(direct.col(2)));
+  reciprocal.col(0) = 2*M_PI/volume * direct.col(1).cross(direct.col(2));
+  reciprocal.col(1) = 2*M_PI/volume * direct.col(2).cross(direct.col(0));
+  reciprocal.col(2) = 2*M_PI/volume * direct.col(0).cross(direct.col(1));
+  
+  for(int j=0;j<3;j++){
+    for(int i=0;i<3;i++){
+      h[j][i] = INVBOHR2INVANGSTROM*reciprocal(j,i);
+    }
+  }
+}
+
+void bandkp::read_energies(boost::filesystem::path bandkppath){
+  
+  //the band file is streamed line by line and every line is distributed over all bands at once
+  boost::filesystem::ifstream filehandle(bandkppath, ios::in | ios::binary);
+  if(!filehandle.is_open()){ //a missing file would otherwise read like an empty one
+    printf("Error: Band file %s could not be opened.\n", bandkppath.string().c_str());
+    discard_bands();
+    return;
+  }
+  boost::iostreams::filtering_istream in;
+  push_decompressor(in, detect_compression(bandkppath));
+  in.push(filehandle);
+  in.exceptions(ios::badbit); //errors of the decompressor are otherwise swallowed and look like the end of the file
+  
+  try{
+    read_lines(in, [&](string_view line){ parse_line(line); });
+  }
+  catch(const ios_base::failure& e){
+    printf("Error: Band file %s could not be decompressed: %s\n", bandkppath.string().c_str(), e.what());
+    discard_bands();
+    return;
+  }
+  
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  if((nbands == 0) || (nread != nvalues)){
+    printf("Error: Band file %s holds %li of %li k-points, no bands were read.\n", bandkppath.string().c_str(), nread, nvalues);
+    discard_bands();
+    return;
+  }
+  for(int b=0;b<nbands;b++){
+    calc_band_range(b);
+  }
+  energydata = energies.data();
+}
+
+void bandkp::parse_line(string_view line){
+  
+  const char* p = skip_whitespace(line.data(), line.data() + line.size());
+  const char* end = line.data() + line.size();
+  if(p == end){
+    return;
+  }
   
-  if(uint(nkpoints[0] * nkpoints[1] * nkpoints[2]) == energies_list.size()){
-    for(int i=0;i<nkpoints[0];i++){
-      for(int j=0;j<nkpoints[1];j++){
-        for(int k=0;k<nkpoints[2];k++){
-	  energies[i][j][k] = energies_list[i*nkpoints[1]*nkpoints[2] + j*nkpoints[2] + k];
-	  if(!inputinev){
-	    energies[i][j][k] *= RYDBERG2EV;
-	  }
-        }
+  long nvalues = long(nkpoints[0]) * nkpoints[1] * nkpoints[2];
+  if(*p == '#'){
+    if(nbands == 0){ //the first comment line holds the number of k-points and the range of bands
+      vector<string_view> tokens;
+      while(p < end){
+	const char* q = skip_token(p, end);
+	tokens.push_back(string_view(p, q - p));
+	p = skip_whitespace(q, end);
+      }
+      if(tokens.size() < 6){
+	printf("Error: Header of band file could not be parsed.\n");
+	return;
+      }
+      long nkp = 0;
+      int firstband = 0, lastband = 0;
+      parse_value(tokens[3].data(), tokens[3].data() + tokens[3].size(), nkp);
+      parse_value(tokens[tokens.size()-2].data(), tokens[tokens.size()-2].data() + tokens[tokens.size()-2].size(), firstband);
+      parse_value(tokens[tokens.size()-1].data(), tokens[tokens.size()-1].data() + tokens[tokens.size()-1].size(), lastband);
+      if(nkp != nvalues){
+	printf("Error: Number of k-points in band file is not equal to the number of k-points calculated from input parameters.\n");
       }
+      nbands = lastband - firstband + 1;
+      for(int b=0;b<nbands;b++){
+	bandnumbers.push_back(firstband + b);
+      }
+      energies.resize(boost::extents[nbands][nkpoints[0]][nkpoints[1]][nkpoints[2]]);
     }
+    return;
   }
-  else{
-    printf("Error: Number of energy values does not match gridsize.\n");
+  
+  if((nbands == 0) || (nread >= nvalues)){
+    return;
+  }
+  p = skip_whitespace(skip_token(p, end), end); //first column is the position along the k-path
+  fptype* data = energies.data();
+  for(int b=0;b<nbands;b++){
+    fptype value = 0;
+    const char* q = parse_value(p, end, value);
+    if(q == p){
+      printf("Error: Energy value could not be parsed.\n");
+    }
+    data[b*nvalues + nread] = value;
+    p = skip_whitespace(q, end);
   }
+  nread++;
 }
 
-boost::array<int, 3> bxsf::get_nkpoints(){
+// Functions for OccupancyWriter class
+
+OccupancyWriter::OccupancyWriter(const boost::multi_array<storetype,3>& energies_in, GlobalSettings& settings, fptype sc_length, boost::filesystem::path outfilepath_in) : energies(energies_in){
   
-  return nkpoints;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, occupancymagic, sizeof(occupancymagic));
+  header.nksc = settings.nksc;
+  header.encoding = (settings.go == 2) ? 1 : 0;
+  header.sc_length = sc_length;
+  header.phi = settings.phi*180.0/M_PI;
+  header.theta = settings.theta*180.0/M_PI;
+  outfilepath = outfilepath_in;
+  worker = thread(&OccupancyWriter::write, this);
 }
 
-boost::multi_array<fptype, 2> bxsf::get_h(){
+OccupancyWriter::~OccupancyWriter(){
   
-  return h;
+  worker.join();
 }
 
-int bxsf::get_bandnumber(){
+void OccupancyWriter::write(){
+  
+  //slices of constant k are stored one after another, within a slice the index is i*nksc + j
+  int nksc = header.nksc;
+  boost::filesystem::ofstream filehandle(outfilepath, ios::out | ios::binary);
+  filehandle.write(reinterpret_cast<const char*>(&header), sizeof(header));
   
-  return bandnumber;
+  if(header.encoding == 0){
+    for(int k=0;k<nksc;k++){
+      vector<uint8_t> bits = pack_slice(k);
+      filehandle.write(reinterpret_cast<const char*>(bits.data()), bits.size());
+    }
+  }
+  else{ //table of byte offsets of all slices relative to the end of the table, followed by the encoded slices
+    vector<vector<uint8_t> > slices(nksc);
+    vector<uint64_t> offsets(nksc + 1, 0);
+    for(int k=0;k<nksc;k++){
+      slices[k] = encode_slice(k);
+      offsets[k+1] = offsets[k] + slices[k].size();
+    }
+    filehandle.write(reinterpret_cast<const char*>(offsets.data()), offsets.size()*sizeof(uint64_t));
+    for(int k=0;k<nksc;k++){
+      filehandle.write(reinterpret_cast<const char*>(slices[k].data()), slices[k].size());
+    }
+  }
+  filehandle.close();
+  if(!filehandle){ //e.g. a full disk, the file would otherwise end early without notice
+    printf("Error: Occupancy file %s could not be written.\n", outfilepath.string().c_str());
+  }
 }
 
-vector<fptype> bxsf::get_energies_list(){
+vector<uint8_t> OccupancyWriter::pack_slice(int k){
   
-  return energies_list;
+  //one bit per k-point, set if the point is outside the fermi surface, least significant bit first
+  int nksc = header.nksc;
+  vector<uint8_t> bits((long(nksc)*nksc + 7)/8, 0);
+  long n = 0;
+  for(int i=0;i<nksc;i++){
+    for(int j=0;j<nksc;j++){
+      if(energies[i][j][k] > 0){
+	bits[n >> 3] |= (1 << (n & 7));
+      }
+      n++;
+    }
+  }
+  return bits;
 }
 
-boost::multi_array<fptype, 3> bxsf::get_energies(){
+vector<uint8_t> OccupancyWriter::encode_slice(int k){
   
-  return energies;
+  //lengths of alternating runs of zeros and ones as LEB128 varints, the first run counts zeros and may be empty
+  int nksc = header.nksc;
+  vector<uint8_t> bytes;
+  auto push_run = [&](uint64_t length){
+    while(length >= 0x80){
+      bytes.push_back(uint8_t(length & 0x7f) | 0x80);
+      length >>= 7;
+    }
+    bytes.push_back(uint8_t(length));
+  };
+  bool current = false;
+  uint64_t run = 0;
+  for(int i=0;i<nksc;i++){
+    for(int j=0;j<nksc;j++){
+      bool bit = (energies[i][j][k] > 0);
+      if(bit != current){
+	push_run(run);
+	current = bit;
+	run = 0;
+      }
+      run++;
+    }
+  }
+  push_run(run); //the last run ends with the slice
+  return bytes;
 }
 
 // Main Functions
 
+template <typename T> const char* parse_value(const char* p, const char* end, T& value){ //returns the position after the parsed value, or p if nothing could be parsed
+  
+  const char* start = skip_whitespace(p, end);
+  if((start < end) && (*start == '+')){
+    start++;
+  }
+  from_chars_result res = from_chars(start, end, value);
+  return (res.ec == errc()) ? res.ptr : p;
+}
+
+const char* skip_whitespace(const char* p, const char* end){
+  
+  while((p < end) && isspace((unsigned char)*p)){
+    p++;
+  }
+  return p;
+}
+
+const char* skip_token(const char* p, const char* end){
+  
+  while((p < end) && !isspace((unsigned char)*p)){
+    p++;
+  }
+  return p;
+}
+
+long count_tokens(const char* p, const char* end){
+  
+  long ntokens = 0;
+  p = skip_whitespace(p, end);
+  while(p < end){
+    ntokens++;
+    p = skip_whitespace(skip_token(p, end), end);
+  }
+  return ntokens;
+}
+
+boost::filesystem::path get_cache_path(boost::filesystem::path path){
+  
+  return boost::filesystem::path(path.string() + ".bbg");
+}
+
+bool is_cache_file(boost::filesystem::path path){
+  
+  char magic[sizeof(cachemagic)] = {0};
+  boost::filesystem::ifstream filehandle(path, ios::in | ios::binary);
+  filehandle.read(magic, sizeof(magic));
+  return (filehandle.gcount() == sizeof(magic)) && (memcmp(magic, cachemagic, sizeof(magic)) == 0);
+}
+
+Compression detect_compression(boost::filesystem::path path){ //compressed files are recognized by their magic bytes
+  
+  unsigned char magic[6] = {0};
+  boost::filesystem::ifstream filehandle(path, ios::in | ios::binary);
+  filehandle.read(reinterpret_cast<char*>(magic), sizeof(magic));
+  int n = filehandle.gcount();
+  
+  Compression compression = COMPRESSION_NONE;
+  if((n >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b)){
+    compression = COMPRESSION_GZIP;
+  }
+  else if((n >= 6) && (memcmp(magic, "\xfd" "7zXZ\0", 6) == 0)){
+    compression = COMPRESSION_XZ;
+  }
+  else if((n >= 4) && (magic[0] == 0x28) && (magic[1] == 0xb5) && (magic[2] == 0x2f) && (magic[3] == 0xfd)){
+    compression = COMPRESSION_ZSTD;
+  }
+  return compression;
+}
+
+void push_decompressor(boost::iostreams::filtering_istream& in, Compression compression){
+  
+  switch(compression){
+    case COMPRESSION_GZIP: in.push(boost::iostreams::gzip_decompressor()); break;
+    case COMPRESSION_XZ: in.push(boost::iostreams::lzma_decompressor()); break;
+    case COMPRESSION_ZSTD: in.push(boost::iostreams::zstd_decompressor()); break;
+    default: break;
+  }
+}
+
+void read_lines(istream& in, const function<void(string_view)>& handler){ //reads the stream block by block and hands over complete lines without copying them
+  
+  vector<char> buffer(1 << 20);
+  size_t filled = 0;
+  bool eof = false;
+  while(!eof){
+    in.read(buffer.data() + filled, buffer.size() - filled);
+    filled += in.gcount();
+    eof = !in;
+    
+    const char* begin = buffer.data();
+    const char* end = begin + filled;
+    const char* last = end; //only complete lines are handled, the remainder is kept for the next block
+    if(!eof){
+      while((last > begin) && (*(last-1) != '\n')){
+        last--;
+      }
+      if(last == begin){ //line longer than the buffer
+        buffer.resize(2*buffer.size());
+        continue;
+      }
+    }
+    
+    const char* p = begin;
+    while(p < last){
+      const char* q = static_cast<const char*>(memchr(p, '\n', last - p));
+      q = (q == NULL) ? last : q;
+      handler(string_view(p, q - p));
+      p = q + 1;
+    }
+    
+    filled = end - last;
+    memmove(buffer.data(), last, filled);
+  }
+}
+
 string trim_all(const std::string &str){  //with a more recent version of boost boost::trim_all() can be used instead of this function
 
   return boost::algorithm::find_format_all_copy(
@@ -149,11 +863,21 @@ void mkdir(boost::filesystem::path dir){
   }
 }
 
-void write_output(GlobalSettings settings, boost::filesystem::path outfilepath, vector<AveragedOrbit> ao){
+string get_output_name(string prefix, GlobalSettings settings){ //the settings are appended to the input file name, the extension is added by the caller
+  
+  return prefix + boost::lexical_cast<string>(
+		  boost::format(".%i_%i_%3.1f_%3.1f_%1.3f_%1.3f_%i_%i") 
+		  % settings.nksc % settings.nsc 
+		  % (settings.phi*180.0/M_PI) % (settings.theta*180.0/M_PI) % settings.maxkdiff 
+		  % settings.maxfreqdiff % settings.minimumfreq % settings.ip);
+}
+
+void write_output(GlobalSettings settings, boost::filesystem::path outfilepath, int bandnumber, const vector<AveragedOrbit>& ao){
   
   boost::filesystem::ofstream outfilehandle(outfilepath);
   int naverages = ao.size();
   
+  outfilehandle << boost::lexical_cast<string>(boost::format("# band : %i") % bandnumber) << endl;
   outfilehandle << boost::lexical_cast<string>(boost::format("# nksc : %i") % settings.nksc) << endl;
   outfilehandle << boost::lexical_cast<string>(boost::format("# phi : %f") % (settings.phi*180.0/M_PI)) << endl;
   outfilehandle << boost::lexical_cast<string>(boost::format("# theta : %f") % (settings.theta*180.0/M_PI)) << endl;
@@ -170,3 +894,159 @@ void write_output(GlobalSettings settings, boost::filesystem::path outfilepath,
   }
   outfilehandle.close();
 }
+
+uint64_t hash_file(boost::filesystem::path path){
+  
+  uint64_t hash = 14695981039346656037ULL; //FNV-1a
+  if(boost::filesystem::file_size(path) == 0){ //an empty file cannot be mapped
+    return hash;
+  }
+  boost::iostreams::mapped_file_source mappedfile(path.string());
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(mappedfile.data());
+  for(size_t i=0;i<mappedfile.size();i++){
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool append_sweep_output(GlobalSettings settings, boost::filesystem::path sweepfilepath, boost::filesystem::path inputpath, uint64_t inputhash, int bandnumber, const vector<AveragedOrbit>& ao){
+  
+  //all runs of a sweep append fixed-width records to one file, an exclusive lock makes concurrent writers safe
+  SweepFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, sweepmagic, sizeof(sweepmagic));
+  header.headersize = sizeof(SweepFileHeader);
+  header.recordsize = sizeof(SweepRecord);
+  header.inputhash = inputhash;
+  header.nksc = settings.nksc;
+  header.nsc = settings.nsc;
+  header.maxkdiff = settings.maxkdiff;
+  header.maxfreqdiff = settings.maxfreqdiff;
+  header.minimumfreq = settings.minimumfreq;
+  header.ip = settings.ip;
+  strncpy(header.inputname, inputpath.filename().string().c_str(), sizeof(header.inputname) - 1);
+  
+  int naverages = ao.size();
+  vector<SweepRecord> records(naverages);
+  for(int i=0;i<naverages;i++){
+    memset(&records[i], 0, sizeof(SweepRecord));
+    records[i].phi = settings.phi*180.0/M_PI;
+    records[i].theta = settings.theta*180.0/M_PI;
+    records[i].band = bandnumber;
+    records[i].f = ao[i].f;
+    records[i].fsdev = ao[i].fsdev;
+    records[i].m = ao[i].m;
+    records[i].msdev = ao[i].msdev;
+    records[i].x = ao[i].x;
+    records[i].xsdev = ao[i].xsdev;
+    records[i].y = ao[i].y;
+    records[i].ysdev = ao[i].ysdev;
+    records[i].z = ao[i].z;
+    records[i].zsdev = ao[i].zsdev;
+    records[i].n = ao[i].n;
+  }
+  
+  int fd = open(sweepfilepath.string().c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if(fd < 0){
+    printf("Error: Sweep file %s could not be opened.\n", sweepfilepath.string().c_str());
+    return false;
+  }
+  flock(fd, LOCK_EX);
+  
+  bool ok = true;
+  off_t size = lseek(fd, 0, SEEK_END);
+  if(size == 0){ //first writer creates the header
+    ok = (write(fd, &header, sizeof(header)) == sizeof(header));
+  }
+  else{
+    SweepFileHeader existing;
+    ok = (pread(fd, &existing, sizeof(existing), 0) == sizeof(existing))
+         && (memcmp(existing.magic, header.magic, sizeof(header.magic)) == 0)
+         && (existing.recordsize == header.recordsize) && (existing.inputhash == header.inputhash)
+         && (existing.nksc == header.nksc) && (existing.nsc == header.nsc) && (existing.maxkdiff == header.maxkdiff)
+         && (existing.maxfreqdiff == header.maxfreqdiff) && (existing.minimumfreq == header.minimumfreq) && (existing.ip == header.ip);
+    if(!ok){
+      printf("Error: Sweep file %s was written with different settings or input.\n", sweepfilepath.string().c_str());
+    }
+  }
+  if(ok && (naverages > 0)){
+    ssize_t nbytes = naverages*sizeof(SweepRecord);
+    ok = (write(fd, records.data(), nbytes) == nbytes);
+  }
+  
+  flock(fd, LOCK_UN);
+  close(fd);
+  return ok;
+}
+
+static bool parse_angle_range(const string& spec, vector<double>& values){ //"min:max:step" or a single angle in degrees
+  
+  vector<string> fields;
+  boost::split(fields, spec, boost::is_any_of(":"));
+  if((fields.size() != 1) && (fields.size() != 3)){
+    return false;
+  }
+  double range[3];
+  for(size_t l=0;l<fields.size();l++){
+    const char* begin = fields[l].data();
+    const char* end = begin + fields[l].size();
+    const char* p = parse_value(begin, end, range[l]);
+    if((p == begin) || (skip_whitespace(p, end) != end)){
+      return false;
+    }
+  }
+  if(fields.size() == 1){
+    values.push_back(range[0]);
+    return true;
+  }
+  if((range[2] <= 0) || (range[1] < range[0])){
+    return false;
+  }
+  long n = long(floor((range[1] - range[0])/range[2] + 1e-9)); //the end of the range is included if it is hit up to rounding
+  for(long i=0;i<=n;i++){
+    values.push_back(range[0] + i*range[2]);
+  }
+  return true;
+}
+
+vector<pair<double,double> > read_angles(string spec){
+  
+  //either a file with one pair "phi theta" in degrees per line or the ranges "phimin:phimax:phistep,thetamin:thetamax:thetastep"
+  vector<pair<double,double> > angles;
+  if(boost::filesystem::is_regular_file(spec)){
+    boost::filesystem::ifstream in(spec);
+    string line;
+    int linenumber = 0;
+    while(getline(in, line)){
+      linenumber++;
+      line = trim_all(line.substr(0, line.find('#')));
+      if(line.empty()){
+	continue;
+      }
+      const char* end = line.data() + line.size();
+      double phi, theta;
+      const char* p = parse_value(line.data(), end, phi);
+      const char* q = (p == line.data()) ? p : parse_value(p, end, theta);
+      if((p == line.data()) || (q == p)){
+	printf("Error: Line %i of angle file %s does not hold phi and theta.\n", linenumber, spec.c_str());
+	return vector<pair<double,double> >();
+      }
+      angles.push_back(make_pair(phi, theta));
+    }
+    return angles;
+  }
+  
+  vector<string> axes;
+  boost::split(axes, spec, boost::is_any_of(","));
+  vector<double> phis, thetas;
+  if((axes.size() != 2) || !parse_angle_range(axes[0], phis) || !parse_angle_range(axes[1], thetas)){
+    printf("Error: %s is neither an angle file nor a range phimin:phimax:phistep,thetamin:thetamax:thetastep.\n", spec.c_str());
+    return angles;
+  }
+  for(size_t i=0;i<phis.size();i++){
+    for(size_t j=0;j<thetas.size();j++){
+      angles.push_back(make_pair(phis[i], thetas[j]));
+    }
+  }
+  return angles;
+}
@@ -20,12 +20,31 @@
 //files.hpp
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <type_traits>
+#include <functional>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <boost/array.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/lzma.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/predef/other/endian.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
+#include <Eigen/Dense>
 
 #include "eval.hpp"
 #include "typedefs.hpp"
@@ -34,28 +53,151 @@ using namespace std;
 #ifndef __BXSF_H_INCLUDED__
 #define __BXSF_H_INCLUDED__
 
-class bxsf{
+struct BandGridCacheHeader{ //header of the binary band grid cache, followed by band numbers, band ranges and the aligned energy array
+  char magic[8];
+  int32_t dataoffset; //offset of the energy array from the beginning of the file in bytes
+  int32_t inputinev; //units of the text file the cache was created from
+  int32_t nkpoints[3];
+  int32_t nbands;
+  float fermi;
+  float h[9];
+};
+
+struct SweepFileHeader{ //header of a sweep result file, describes the settings shared by all records
+  char magic[8];
+  int32_t headersize;
+  int32_t recordsize;
+  uint64_t inputhash; //FNV-1a hash of the input file
+  int32_t nksc;
+  float nsc;
+  float maxkdiff;
+  float maxfreqdiff;
+  float minimumfreq;
+  int32_t ip;
+  char inputname[208];
+};
+
+//The records are stored row by row, so that several processes can append to the file without rewriting it.
+//Every column is still a fixed-width field at a fixed offset, a memory mapped structured array gives strided column views.
+struct SweepRecord{ //one averaged extremal orbit, every column has a fixed width of four bytes
+  float phi;
+  float theta;
+  int32_t band;
+  float f;
+  float fsdev;
+  float m;
+  float msdev;
+  float x;
+  float xsdev;
+  float y;
+  float ysdev;
+  float z;
+  float zsdev;
+  int32_t n;
+  int32_t reserved[2];
+};
+
+static_assert(sizeof(SweepFileHeader) == 256, "sweep file header must have a fixed size");
+static_assert(sizeof(SweepRecord) == 64, "sweep records must have a fixed size");
+
+struct OccupancyHeader{ //header of the bit-packed occupancy volume of the super cell
+  char magic[8];
+  int32_t nksc;
+  int32_t encoding; //0 == one bit per k-point, 1 == run-length encoded slices
+  float sc_length;
+  float phi;
+  float theta;
+  int32_t reserved;
+};
+
+enum Compression {COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_XZ, COMPRESSION_ZSTD};
+
+struct BandGridStreamState{ //progress of the streaming parser across decompressed blocks
+  int nheadervalues; //number of values read after BANDGRID_3D_BANDS, the header holds 16 values
+  double headervalues[16]; //number of bands, nkpoints, origin and reciprocal lattice vectors
+  int bandindex; //index of the band currently read, -1 before the first band
+  long nread; //number of energies read for the current band
+  bool finished;
+};
+
+class BandGrid{ //band energies on the k-point grid of the reciprocal unit cell, common to all input formats
   public:
-    bxsf(boost::filesystem::path path, int inputinev_in);
+    void write_cache(boost::filesystem::path cachepath);
     boost::array<int, 3> get_nkpoints();
     boost::multi_array<fptype, 2> get_h();
-    int get_bandnumber();
-    vector<fptype> get_energies_list();
-    boost::multi_array<fptype, 3> get_energies();
-  private:
-    boost::filesystem::path filepath;
-    boost::filesystem::ifstream filehandle;
+    int get_bandcount();
+    int get_bandnumber(int bandindex);
+    bool band_crosses_fermi(int bandindex);
+    vector<fptype> get_energies_list(int bandindex);
+    boost::multi_array<fptype, 3> get_energies(int bandindex);
+    boost::const_multi_array_ref<fptype, 3> get_energies_ref(int bandindex);
+  protected:
+    BandGrid();
     fptype fermi;
     boost::array<int, 3> nkpoints; //number is number of entries
     boost::multi_array<fptype, 2> h; //number is number of dimensions, number of elements must be set in constructor
-    int bandnumber, inputinev;
-    vector<fptype> energies_list;
-    boost::multi_array<fptype, 3> energies;
+    int nbands, inputinev;
+    vector<int> bandnumbers;
+    vector<fptype> emin, emax; //energy range of each band relative to the fermi energy
+    boost::multi_array<fptype, 4> energies; //all bands, first index is the band index
+    boost::iostreams::mapped_file_source mappedcache;
+    const fptype* energydata; //points either to energies or into the mapped cache file
+    bool read_cache(boost::filesystem::path cachepath, bool checkunits);
+    void calc_band_range(int bandindex);
+    void discard_bands();
+};
+
+class bxsf : public BandGrid{
+  public:
+    bxsf(boost::filesystem::path path, int inputinev_in);
+  private:
+    boost::filesystem::path filepath;
     void read();
+    void read_compressed(Compression compression);
+    void parse_stream_line(string_view line, BandGridStreamState& state);
+    void finish_stream_band(BandGridStreamState& state);
+    long parse_energies(const char* begin, const char* end, fptype* dest, long nvalues);
+};
+
+class OccupancyWriter{ //writes the occupancy of the super cell in a background thread while the calculation goes on
+  public:
+    OccupancyWriter(const boost::multi_array<storetype,3>& energies_in, GlobalSettings& settings, fptype sc_length, boost::filesystem::path outfilepath_in);
+    ~OccupancyWriter();
+  private:
+    const boost::multi_array<storetype,3>& energies; //must stay alive until the writer is destroyed
+    OccupancyHeader header;
+    boost::filesystem::path outfilepath;
+    thread worker;
+    void write();
+    vector<uint8_t> pack_slice(int k);
+    vector<uint8_t> encode_slice(int k);
+};
+
+class bandkp : public BandGrid{ //reads FPLO lattice data from =.in and band energies from +band_kp, energies are given in eV relative to the fermi energy
+  public:
+    bandkp(boost::filesystem::path dotinpath, boost::filesystem::path bandkppath, const boost::array<int, 3>& nkpoints_in);
+  private:
+    long nread; //number of k-points read so far
+    void read_lattice(boost::filesystem::path dotinpath);
+    void read_energies(boost::filesystem::path bandkppath);
+    void parse_line(string_view line);
 };
 
 #endif
 
+template <typename T> const char* parse_value(const char* p, const char* end, T& value);
+const char* skip_whitespace(const char* p, const char* end);
+const char* skip_token(const char* p, const char* end);
+long count_tokens(const char* p, const char* end);
+boost::filesystem::path get_cache_path(boost::filesystem::path path);
+bool is_cache_file(boost::filesystem::path path);
+Compression detect_compression(boost::filesystem::path path);
+void push_decompressor(boost::iostreams::filtering_istream& in, Compression compression);
+void read_lines(istream& in, const function<void(string_view)>& handler);
 string trim_all(const std::string &str);
 void mkdir(boost::filesystem::path dir);
-void write_output(GlobalSettings settings, boost::filesystem::path outfilepath, vector<AveragedOrbit> ao);
+string get_output_name(string prefix, GlobalSettings settings);
+void write_output(GlobalSettings settings, boost::filesystem::path outfilepath, int bandnumber, const vector<AveragedOrbit>& ao);
+uint64_t hash_file(boost::filesystem::path path);
+bool append_sweep_output(GlobalSettings settings, boost::filesystem::path sweepfilepath, boost::filesystem::path inputpath, uint64_t inputhash, int bandnumber, const vector<AveragedOrbit>& ao);
+vector<pair<double,double> > read_angles(string spec);
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//grid.cpp
+#include "grid.hpp"
+
+InterpolationGrid::InterpolationGrid(const boost::const_multi_array_ref<fptype,3>& data_in, const boost::array<int,3>& nkpoints){
+  
+  n1 = nkpoints[0];
+  n2 = nkpoints[1];
+  n3 = nkpoints[2];
+  nb2 = (n2 + 3)/4;
+  nb3 = (n3 + 3)/4;
+  data = data_in.data();
+  
+#ifdef DHVA_BRICKED_GRID
+  int nb1 = (n1 + 3)/4;
+  vector<fptype>* b = new vector<fptype>(long(nb1)*nb2*nb3*64, 0);
+  for(int i1=0;i1<n1;i1++){
+    for(int i2=0;i2<n2;i2++){
+      for(int i3=0;i3<n3;i3++){
+	long brick = ((i1 >> 2)*nb2 + (i2 >> 2))*nb3 + (i3 >> 2);
+	(*b)[(brick << 6) + (((i1 & 3) << 4) | ((i2 & 3) << 2) | (i3 & 3))] = data[(i1*n2 + i2)*n3 + i3];
+      }
+    }
+  }
+  bricks.reset(b);
+  data = bricks->data();
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//grid.hpp
+#include <vector>
+#include <memory>
+#include <boost/array.hpp>
+#include <boost/multi_array.hpp>
+
+#include "typedefs.hpp"
+
+using namespace std;
+
+#ifndef INTERPOLATION_GRID_H
+#define INTERPOLATION_GRID_H
+
+//4x4x4 bricks keep the stencil of a voxel within few cache lines when the super cell is rotated against the grid
+//the layout is chosen at compile time with -DDHVA_BRICKED_GRID, the default reads the band grid in place
+class InterpolationGrid{ //periodic grid of band energies as seen by the interpolators, copies are cheap and share the data
+  public:
+    InterpolationGrid(const boost::const_multi_array_ref<fptype,3>& data_in, const boost::array<int,3>& nkpoints);
+    inline fptype operator()(int i1, int i2, int i3) const {
+      if((i1 %= n1) < 0) i1 += n1;
+      if((i2 %= n2) < 0) i2 += n2;
+      if((i3 %= n3) < 0) i3 += n3;
+#ifdef DHVA_BRICKED_GRID
+      return data[((((i1 >> 2)*nb2 + (i2 >> 2))*nb3 + (i3 >> 2)) << 6) + (((i1 & 3) << 4) | ((i2 & 3) << 2) | (i3 & 3))];
+#else
+      return data[(i1*n2 + i2)*n3 + i3];
+#endif
+    }
+    const fptype* get_data() const {return data;}
+    int get_n1() const {return n1;}
+    int get_n2() const {return n2;}
+    int get_n3() const {return n3;}
+  private:
+    const fptype* data; //points to the band grid in place or to bricks
+    int n1, n2, n3;
+    int nb2, nb3; //number of bricks along the second and third axis
+    shared_ptr<const vector<fptype> > bricks; //shared by all copies of the grid
+};
+
+#endif
@@ -20,10 +20,14 @@
 //main.cpp
 #include <iostream>
 #include <string>
+#include <memory>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
+#ifdef DHVA_MPI
+#include <mpi.h>
+#endif
 
 #include "files.hpp"
 #include "settings.hpp"
@@ -31,14 +35,104 @@
 #include "sc.hpp"
 #include "orbit.hpp"
 #include "eval.hpp"
+#include "sweep.hpp"
 using namespace std;
 
+#ifdef DHVA_MPI
+struct MpiSession{ //MPI is finalized on every return from main
+  MpiSession(int& argc, char**& argv){
+    int threadsupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadsupport); //only the main thread of every rank communicates
+  }
+  ~MpiSession(){
+    MPI_Finalize();
+  }
+};
+#endif
+
 int main(int argc, char* argv[]){
   
   GlobalSettings settings;
   boost::filesystem::path filepath;
+  boost::filesystem::path sweepfilepath; //optional, results of all runs of a sweep are appended to this file
+  vector<pair<double,double> > angles; //field directions in degrees, only set in sweep mode
+#ifdef DHVA_MPI
+  MpiSession mpisession(argc, argv);
+  int mpirank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &mpirank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  bool sweepmode = (argc >= 11) && (string(argv[1]) == "sweep");
+  if((mpirank > 0) && !sweepmode){ //only angle sweeps are distributed, everything else runs on rank 0
+    return 0;
+  }
+#endif
   
-  if(argc != 12){
+  if((argc >= 4) && (string(argv[1]) == "convert")){ //convert a text band grid into a binary cache that is memory mapped by later runs
+    filepath = argv[2];
+    boost::filesystem::path cachepath = (argc >= 5) ? boost::filesystem::path(argv[4]) : get_cache_path(filepath);
+    if(!boost::filesystem::exists(filepath)){
+      printf("Error. Input file does not exist.\n");
+      return 1;
+    }
+    cout << "Started converting input file." << endl;
+    bxsf file(filepath, atoi(argv[3]));
+    if(file.get_bandcount() == 0){ //the reader has reported why
+      printf("Error. No bands could be read, no cache was written.\n");
+      return 1;
+    }
+    file.write_cache(cachepath);
+    cout << "Finished writing binary band grid cache to " << cachepath.string() << "." << endl;
+    return 0;
+  }
+  else if((argc >= 7) && (string(argv[1]) == "fplo")){ //read FPLO =.in and +band_kp files directly and store all bands in a binary cache
+    boost::filesystem::path dotinpath = argv[2];
+    boost::filesystem::path bandkppath = argv[3];
+    boost::array<int, 3> nkpoints = {{atoi(argv[4]), atoi(argv[5]), atoi(argv[6])}};
+    boost::filesystem::path cachepath = (argc >= 8) ? boost::filesystem::path(argv[7]) : get_cache_path(bandkppath);
+    if(!boost::filesystem::exists(dotinpath) || !boost::filesystem::exists(bandkppath)){
+      printf("Error. Input file does not exist.\n");
+      return 1;
+    }
+    cout << "Started reading FPLO input files." << endl;
+    bandkp file(dotinpath, bandkppath, nkpoints);
+    if(file.get_bandcount() == 0){ //the reader has reported why
+      printf("Error. No bands could be read, no cache was written.\n");
+      return 1;
+    }
+    file.write_cache(cachepath);
+    cout << "Finished writing binary band grid cache to " << cachepath.string() << "." << endl;
+    return 0;
+  }
+  else if((argc >= 11) && (string(argv[1]) == "sweep")){ //all field directions of an angle sweep in one process
+    filepath = argv[2];
+    settings.inputinev = atoi(argv[3]);
+    settings.nksc = atoi(argv[4]);
+    settings.nsc = atoi(argv[5]);
+    settings.maxkdiff = atof(argv[7]);
+    settings.maxfreqdiff = atof(argv[8]);
+    settings.minimumfreq = atof(argv[9]);
+    settings.ip = atoi(argv[10]);
+    settings.go = 0;
+#ifdef DHVA_MPI
+    if(mpirank > 0){ //only rank 0 reads the input, the other ranks receive the bands and calculate the angles handed out to them
+      serve_sweep(settings);
+      return 0;
+    }
+#endif
+    cout << "Using command line settings for an angle sweep." << endl;
+    angles = read_angles(argv[6]);
+    if(argc >= 12){
+      sweepfilepath = argv[11];
+    }
+    if(angles.empty()){
+      printf("Error. No angles to sweep.\n");
+#ifdef DHVA_MPI
+      broadcast_sweep_end();
+#endif
+      return 1;
+    }
+  }
+  else if((argc != 12) && (argc != 13)){
     cout << "Using precompiled settings." << endl;
     filepath = "sphere.bxsf";
     settings.inputinev = 0;
@@ -65,6 +159,9 @@ int main(int argc, char* argv[]){
     settings.minimumfreq = atof(argv[9]);
     settings.ip = atoi(argv[10]);
     settings.go = atoi(argv[11]);
+    if(argc == 13){
+      sweepfilepath = argv[12];
+    }
   }
   
   string datadirstr = "data/";
@@ -74,76 +171,102 @@ int main(int argc, char* argv[]){
   if(!boost::filesystem::exists(filepath)){
     printf("Error. Input file does not exist.\n");
   }
+  else if(boost::filesystem::file_size(filepath) == 0){
+    printf("Error. Input file %s is empty.\n", filepath.string().c_str());
+  }
   else{
     cout << "Started reading input file." << endl;
     bxsf file(filepath, settings.inputinev);
     cout << "Finished reading input file." << endl;
     
-    cout << "Started reconstruction of reciprocal unit cell." << endl;
-    ReciprocalUnitCell ruc(file.get_nkpoints(), file.get_h(), file.get_energies());
-    cout << "Finished reconstruction of reciprocal unit cell." << endl;
+    string filenamestr = boost::lexical_cast<string>(filepath.filename());
+    filenamestr.erase(0, 1);
+    filenamestr.erase(filenamestr.size()-1);
+    int nbands = file.get_bandcount();
+    SweepOutput output; //the input is hashed once per process and shared by all bands and angles
+    output.sweepfilepath = sweepfilepath;
+    output.inputpath = filepath;
+    output.inputhash = sweepfilepath.empty() ? 0 : hash_file(filepath);
+    
+    for(int b=0;b<nbands;b++){ //every band crossing the fermi energy is processed separately
+      int bandnumber = file.get_bandnumber(b);
+      if(!file.band_crosses_fermi(b)){
+        cout << boost::format("Skipping band %i, it does not cross the Fermi energy.") % bandnumber << endl;
+        continue;
+      }
+      cout << boost::format("Processing band %i.") % bandnumber << endl;
+      string bandstr = (nbands > 1) ? boost::lexical_cast<string>(boost::format(".band%i") % bandnumber) : "";
+      
+      cout << "Started reconstruction of reciprocal unit cell." << endl;
+      ReciprocalUnitCell ruc(file.get_nkpoints(), file.get_h(), file.get_energies_ref(b));
+      cout << "Finished reconstruction of reciprocal unit cell." << endl;
+      
+      if(!angles.empty()){
+	output.outnameprefix = datadirstr + filenamestr + bandstr;
+	output.bandnumber = bandnumber;
+	AngleSweep sweep(settings, angles, output);
+#ifdef DHVA_MPI
+	if(nranks > 1){
+	  cout << boost::format("Started distributing %i angles to %i ranks.") % angles.size() % (nranks - 1) << endl;
+	  broadcast_band(bandnumber, file.get_nkpoints(), file.get_h(), file.get_energies_ref(b).data());
+	  sweep.distribute();
+	  continue;
+	}
+#endif
+	cout << "Started calculating angles." << endl;
+	sweep.run(ruc);
+	continue;
+      }
+      string outnamestr = get_output_name(datadirstr + filenamestr + bandstr, settings);
     
-    cout << "Started populating super cell." << endl;
-    SuperCell sc(settings, ruc);
-    cout << "Finished populating super cell." << endl;
+      cout << "Started populating super cell." << endl;
+      SuperCell sc(settings, ruc);
+      cout << "Finished populating super cell." << endl;
     
-    cout << "Started orbit detection." << endl;
-    OrbitFinder orbit(settings, sc);
-    cout << "Finished orbit detection." << endl;
+      unique_ptr<OccupancyWriter> occupancy; //written in the background, joined before the super cell is destroyed
+      if(settings.go > 0){
+        cout << "Started writing graphical output in the background." << endl;
+        occupancy.reset(new OccupancyWriter(*sc.get_energies_pointer(), settings, sc.get_sc_length(), outnamestr + ".occ"));
+      }
     
-    cout << "Started evaluating orbits." << endl;
-    OrbitEvaluator eval(orbit.get_orbits_pointer(), sc.get_sc_length(), settings.nsc);
-    cout << "Finished evaluating orbits." << endl;
+      cout << "Started orbit detection." << endl;
+      OrbitFinder orbit(settings, sc);
+      cout << "Finished orbit detection." << endl;
     
-    cout << "Started matching fermi surface sheets." << endl;
-    SheetMatcher match(eval.get_evaluated_orbits());
-    cout << "Finished matching fermi surface sheets." << endl;
+      cout << "Started evaluating orbits." << endl;
+      OrbitEvaluator eval(*orbit.get_orbits_pointer(), sc.get_grid());
+      cout << "Finished evaluating orbits." << endl;
     
-    cout << "Started singling out extremal frequencies." << endl;
-    FrequencyCalculator freqcalc(settings, match.get_sheets(), ruc.get_h());
-    cout << "Finished singling out extremal frequencies." << endl;
+      cout << "Started matching fermi surface sheets." << endl;
+      SheetMatcher match(eval.get_evaluated_orbits());
+      cout << "Finished matching fermi surface sheets." << endl;
     
-    cout << "Starting to write output file." << endl;
-    string filenamestr = boost::lexical_cast<string>(filepath.filename());
-    filenamestr.erase(0, 1);
-    filenamestr.erase(filenamestr.size()-1);
-    boost::filesystem::path outfilepath = datadirstr + boost::lexical_cast<string>(
-					      boost::format("%s.%i_%i_%3.1f_%3.1f_%1.3f_%1.3f_%i_%i.out") 
-					      % filenamestr % settings.nksc % settings.nsc 
-					      % (settings.phi*180.0/M_PI) % (settings.theta*180.0/M_PI) % settings.maxkdiff 
-					      % settings.maxfreqdiff % settings.minimumfreq % settings.ip);
-    write_output(settings, outfilepath, freqcalc.get_properties());
-    cout << "Finished writing output file." << endl;
+      cout << "Started singling out extremal frequencies." << endl;
+      FrequencyCalculator freqcalc(settings, match.get_sheets(), ruc.get_h());
+      cout << "Finished singling out extremal frequencies." << endl;
     
-    if(settings.go == 1){
-      cout << "Started writing graphical output." << endl;
+      cout << "Starting to write output file." << endl;
+      if(sweepfilepath.empty()){
+        boost::filesystem::path outfilepath = outnamestr + ".out";
+        write_output(settings, outfilepath, bandnumber, freqcalc.get_properties());
+      }
+      else{
+        append_sweep_output(settings, output.sweepfilepath, output.inputpath, output.inputhash, bandnumber, freqcalc.get_properties());
+      }
+      cout << "Finished writing output file." << endl;
       
-      boost::multi_array<fptype,3> energies;
-      energies.resize(boost::extents[settings.nksc][settings.nksc][settings.nksc]);
-      energies = sc.get_energies();
-    
-      for(int k=1;k<settings.nksc-1;k++){
-        boost::filesystem::path outfilepath3(boost::lexical_cast<string>(boost::format("data/graphical%03i.txt") % k));
-        boost::filesystem::ofstream outfilehandle3(outfilepath3);
-   
-        for(int i=settings.nksc-1;i>-1;i--){
-          string line = boost::lexical_cast<string>(boost::format("%3i ") % i);
-          for(int j=0;j<settings.nksc;j++){
-	     if(energies[i][j][k] > 0){
-	       line += "1";
-	     }
-	     else{
-	       line += "0";
-	     }
-          }
-          outfilehandle3 << line << endl;
-        }
-        outfilehandle3.close();
+      if(occupancy){
+        occupancy.reset();
+        cout << "Finished writing graphical output." << endl;
       }
-      cout << "Finished writing graphical output." << endl;
     }
     cout << "Program finished." << endl;
   }
   
+#ifdef DHVA_MPI
+  if(!angles.empty()){
+    broadcast_sweep_end();
+  }
+#endif
   return 0;
 }
@@ -23,52 +23,86 @@
 OrbitFinder::OrbitFinder(GlobalSettings& settings, SuperCell& sc){
   
   nksc = settings.nksc;
-  energies.resize(boost::extents[nksc][nksc][nksc]);
-  kpoints.resize(boost::extents[nksc][nksc][nksc][3]);
-  unchecked.resize(boost::extents[nksc][nksc][nksc]);
   orbitcont.set_slicecount(nksc);
   
-  energies = *sc.get_energies_pointer();
-  kpoints = *sc.get_kpoints_pointer();
+  //slices never interact, the cost of a slice depends on the length of its orbits
+  #pragma omp parallel
+  {
+    SliceTracer tracer(nksc, sc, orbitcont);
+    #pragma omp for schedule(dynamic)
+    for(int k=1;k<nksc;k++){
+      tracer.trace(k);
+    }
+  }
+}
+
+OrbitContainer OrbitFinder::get_orbits(){
+  
+  return orbitcont;
+}
+
+OrbitContainer* OrbitFinder::get_orbits_pointer(){
+ 
+  return &orbitcont;
+}
+
+SliceTracer::SliceTracer(int nksc_in, SuperCell& sc_in, OrbitContainer& orbitcont_in) : grid(sc_in.get_grid()), sc(sc_in), orbitcont(orbitcont_in){
+  
+  nksc = nksc_in;
+  nwords = (nksc + 63)/64;
+  inside.resize(nksc*nwords);
+  visited.resize(nksc*nwords);
+}
+
+void SliceTracer::trace(int k_in){
+  
+  //the stepper never leaves slice k, so only one slice of the super cell is held at a time
+  sc.get_slice(k_in, energies);
+  fill_bitplanes();
+  start(k_in);
+  orbitcont.delete_empty_and_open_orbits(k_in);
+}
+
+void SliceTracer::fill_bitplanes(){
   
   for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	unchecked[i][j][k] = true;
+    for(int w=0;w<nwords;w++){
+      uint64_t word = 0;
+      int jmax = min(64, nksc - 64*w);
+      for(int b=0;b<jmax;b++){
+	word |= uint64_t(energies[i][64*w + b] <= 0) << b;
       }
+      inside[i*nwords + w] = word;
+      visited[i*nwords + w] = 0;
     }
   }
-  
-  start();
-  orbitcont.delete_empty_and_open_orbits();
 }
 
-void OrbitFinder::start(){
+void SliceTracer::start(const int k_in){
   
-  for(int k=1;k<nksc;k++){
-    int i = 1, j = 1;
-    while(i < nksc - 1){ //do if we are not finished with this slice
-      while(j < nksc - 1){ //do if we are not at the end of a row
-	if(unchecked[i][j][k]){
-	  unchecked[i][j][k] = false;
-	  if(energies[i][j][k] <= 0){
-	    stepper(i, j, k);
-	  }
-	  else{
-	    j++; //step right
-	  }
-	}
-	else{
-	  j++; //step right
-	}
-      } //end inner while
-      i++; //go to start of next row
-      j=1;
-    } //end outer while
-  } //end for
+  //seeds are inside and not yet visited, a whole word of 64 points is skipped if it contains none
+  int k = k_in;
+  for(int i=1;i<nksc-1;i++){
+    int j = 1;
+    while(j < nksc - 1){
+      int w = j >> 6;
+      uint64_t seeds = inside[i*nwords + w] & ~visited[i*nwords + w] & (~uint64_t(0) << (j & 63));
+      if(seeds == 0){
+	j = (w + 1) << 6;
+	continue;
+      }
+      j = (w << 6) + __builtin_ctzll(seeds);
+      if(j >= nksc - 1){
+	break;
+      }
+      visited[i*nwords + w] |= uint64_t(1) << (j & 63);
+      stepper(i, j, k); //the stepper marks the points it glances at, so the word is read again
+      j++;
+    }
+  }
 }
 
-void OrbitFinder::stepper(const int i_in, const int j_in, const int k_in){
+void SliceTracer::stepper(const int i_in, const int j_in, const int k_in){
   
   //cout << "Stepper started." << endl;
   i = i_in;
@@ -110,7 +144,7 @@ void OrbitFinder::stepper(const int i_in, const int j_in, const int k_in){
   }
 }
 
-void OrbitFinder::glance1(){
+void SliceTracer::glance1(){
   
   if(!point_on_sc_border()){
     dir = new_glance_direction_for_glance1();
@@ -127,7 +161,7 @@ void OrbitFinder::glance1(){
   }
 }
 
-void OrbitFinder::glance2(){
+void SliceTracer::glance2(){
 
   dir = new_glance_direction_for_glance2();
   switch(dir){
@@ -138,7 +172,7 @@ void OrbitFinder::glance2(){
   } 
 }
 
-inline int OrbitFinder::new_glance_direction_for_glance1(){
+inline int SliceTracer::new_glance_direction_for_glance1(){
   
   int dir = -1; //0==north, 1==east, 2==south, 3 == west
   if(north_of(i, j, ig, jg)){
@@ -160,7 +194,7 @@ inline int OrbitFinder::new_glance_direction_for_glance1(){
   return dir;
 }
 
-inline int OrbitFinder::new_glance_direction_for_glance2(){
+inline int SliceTracer::new_glance_direction_for_glance2(){
   
   int dir = -1; //0==north, 1==east, 2==south, 3 == west
   if(north_of(i, j, i_bef, j_bef)){
@@ -182,38 +216,35 @@ inline int OrbitFinder::new_glance_direction_for_glance2(){
   return dir;
 }
 
-inline bool OrbitFinder::north_of(int i1, int j1, int i2, int j2){
+inline bool SliceTracer::north_of(int i1, int j1, int i2, int j2){
   
   return ((i1 == (i2 - 1)) && (j1 == j2));
 }
 
-inline bool OrbitFinder::east_of(int i1, int j1, int i2, int j2){
+inline bool SliceTracer::east_of(int i1, int j1, int i2, int j2){
   
   return ((i1 == i2) && (j1 == (j2 - 1)));
 }
 
-inline bool OrbitFinder::south_of(int i1, int j1, int i2, int j2){
+inline bool SliceTracer::south_of(int i1, int j1, int i2, int j2){
   
   return ((i1 == (i2 + 1)) && (j1 == j2));
 }
 
-inline bool OrbitFinder::west_of(int i1, int j1, int i2, int j2){
+inline bool SliceTracer::west_of(int i1, int j1, int i2, int j2){
   
   return ((i1 == i2) && (j1 == (j2 + 1)));
 }
 
-void OrbitFinder::record_fs(){
+void SliceTracer::record_fs(){
   
   OrbitPoint p;
-  fptype x = kpoints[i][j][k][0]; //these are actual sc k-space coordinates
-  fptype y = kpoints[i][j][k][1];
-  fptype x_bef = kpoints[i_bef][j_bef][k][0];
-  fptype y_bef = kpoints[i_bef][j_bef][k][1];
-  fptype xg = kpoints[ig][jg][k][0];
-  fptype yg = kpoints[ig][jg][k][1];
-  fptype E = energies[i][j][k];
-  fptype Eg = energies[ig][jg][k];
-  fptype E_bef = energies[i_bef][j_bef][k];
+  fptype x = grid.kval(i); //these are actual sc k-space coordinates
+  fptype y = grid.kval(j);
+  fptype xg = grid.kval(ig);
+  fptype yg = grid.kval(jg);
+  fptype E = energies[i][j];
+  fptype Eg = energies[ig][jg];
   
   p.i = i;
   p.j = j;
@@ -221,59 +252,56 @@ void OrbitFinder::record_fs(){
   p.jg = jg;
   p.x = x - E/(Eg - E)*(xg - x);
   p.y = y - E/(Eg - E)*(yg - y);
-  p.dEparallel = (Eg - E)/((xg-x) + (yg-y));
-  p.dEperpendicular = 0;
-  p.dir = dir;
-  
-  if(!orbitcont.last_orbit_empty(k)){
-    OrbitPoint plast = orbitcont.get_last_orbitpoint(k);
-    plast.dEperpendicular = (E - E_bef)/((x-x_bef) + (y-y_bef));
-    orbitcont.update_last_orbitpoint(k, plast);
-  }
-  //do not exchange updating plast and adding p
+  
+  //the interpolated gradient at the crossing replaces finite differences between neighbouring grid points
+  Eigen::Matrix<fptype,3,1> kpoint, gradient;
+  kpoint << p.x, p.y, grid.kval(k);
+  gradient = sc.get_gradient(kpoint);
+  p.dE = sqrt(pow(gradient(0,0),2) + pow(gradient(1,0),2));
+  
   orbitcont.add_orbitpoint(k, p);
 }
 
-inline void OrbitFinder::glance_north(){
+inline void SliceTracer::glance_north(){
   
   ig = i + 1;
   jg = j;
 }
 
-inline void OrbitFinder::glance_east(){
+inline void SliceTracer::glance_east(){
   
   ig = i;
   jg = j + 1;
 }
 
-inline void OrbitFinder::glance_south(){
+inline void SliceTracer::glance_south(){
   
   ig = i - 1;
   jg = j;
 }
 
-inline void OrbitFinder::glance_west(){
+inline void SliceTracer::glance_west(){
   
   ig = i;
   jg = j - 1;
 }
 
-void OrbitFinder::set_checked(){
+void SliceTracer::set_checked(){
   
-  unchecked[ig][jg][k] = false;
+  visited[ig*nwords + (jg >> 6)] |= uint64_t(1) << (jg & 63);
 }
 
-bool OrbitFinder::orbit_closed(){
+bool SliceTracer::orbit_closed(){
   
   return orbitcont.simple_orbit_closed(k);
 }
 
-bool OrbitFinder::glanced_outside_fs(){
+bool SliceTracer::glanced_outside_fs(){
  
-  return (energies[ig][jg][k] > 0);
+  return (energies[ig][jg] > 0);
 }
 
-void OrbitFinder::step_to_glanced_point(){
+void SliceTracer::step_to_glanced_point(){
   
   update_stephistory();
   
@@ -283,7 +311,7 @@ void OrbitFinder::step_to_glanced_point(){
   j = jg;
 }
 
-bool OrbitFinder::point_on_sc_border(){
+bool SliceTracer::point_on_sc_border(){
   
   bool isonborder = false;
   if((i>=(nksc - 1)) || (j >= (nksc - 1)) || (k >= (nksc - 1)) || (i<=0) || (j<=0) || (k<=0)){
@@ -292,12 +320,12 @@ bool OrbitFinder::point_on_sc_border(){
   return isonborder;
 }
 
-bool OrbitFinder::circle_detected(){
+bool SliceTracer::circle_detected(){
   
   return (((ip[0] == ip[4]) && (jp[0] == jp[4])) && ((ip[1] == ip[5]) && (jp[1] == jp[5])));
 }
 
-void OrbitFinder::update_stephistory(){
+void SliceTracer::update_stephistory(){
   
   for(int i=1;i<6;i++){
     ip[i-1] = ip[i];
@@ -307,16 +335,6 @@ void OrbitFinder::update_stephistory(){
   jp[5] = jg;
 }
 
-OrbitContainer OrbitFinder::get_orbits(){
-  
-  return orbitcont;
-}
-
-OrbitContainer* OrbitFinder::get_orbits_pointer(){
- 
-  return &orbitcont;
-}
-
 OrbitContainer::OrbitContainer(){
   
 }
@@ -324,42 +342,48 @@ OrbitContainer::OrbitContainer(){
 void OrbitContainer::set_slicecount(int n){
   
   nslices = n;
-  orbitdata.resize(nslices);
+  slices.resize(nslices);
+  spares.resize(omp_get_max_threads());
+  for(int i=0;i<nslices;i++){
+    slices[i].offsets.assign(1, 0);
+  }
 }
 
 void OrbitContainer::new_orbit(int sliceindex){
   
-  orbitdata[sliceindex].resize(orbitdata[sliceindex].size()+1);
-}
-
-void OrbitContainer::add_orbitpoint(int sliceindex, OrbitPoint p){
-  
-  orbitdata[sliceindex][orbitdata[sliceindex].size()-1].push_back(p);
-  //cout << "Adding " << p.x << " " << p.y << "." << endl;
-}
-
-OrbitPoint OrbitContainer::get_first_orbitpoint(int sliceindex){
-  
-  int orbitnumber = orbitdata[sliceindex].size() - 1;
-  return orbitdata[sliceindex][orbitnumber][0];
+  OrbitSlice& s = slices[sliceindex];
+  if((s.offsets.size() == 1) && (s.x.capacity() == 0)){ //first orbit of this slice
+    swap(s, spares[omp_get_thread_num()]);
+    s.offsets.assign(1, 0);
+    s.x.clear(); s.y.clear(); s.dE.clear();
+    s.i.clear(); s.j.clear(); s.ig.clear(); s.jg.clear();
+  }
+  s.offsets.push_back(s.offsets.back());
 }
 
-OrbitPoint OrbitContainer::get_last_orbitpoint(int sliceindex){
+void OrbitContainer::add_orbitpoint(int sliceindex, const OrbitPoint& p){
   
-  int orbitnumber = orbitdata[sliceindex].size()-1;
-  int pointnumber = orbitdata[sliceindex][orbitnumber].size()-1;
-  return orbitdata[sliceindex][orbitnumber][pointnumber];
+  OrbitSlice& s = slices[sliceindex];
+  s.x.push_back(p.x);
+  s.y.push_back(p.y);
+  s.dE.push_back(p.dE);
+  s.i.push_back(p.i);
+  s.j.push_back(p.j);
+  s.ig.push_back(p.ig);
+  s.jg.push_back(p.jg);
+  s.offsets.back()++;
 }
 
 bool OrbitContainer::orbit_closed(int sliceindex, int orbitindex){
   
-  int npoints = orbitdata[sliceindex][orbitindex].size();
+  const OrbitSlice& s = slices[sliceindex];
+  int first = s.offsets[orbitindex];
+  int npoints = s.offsets[orbitindex+1] - first;
   bool orbit_empty = (npoints < 3); //we need at least three points to calculate an area
-  //cout << npoints << " " << orbit_empty << endl;
   bool orbit_open = false;
   if(!orbit_empty){
-    orbit_open = (orbitdata[sliceindex][orbitindex][0].x != orbitdata[sliceindex][orbitindex][npoints-1].x) || 
-                 (orbitdata[sliceindex][orbitindex][0].y != orbitdata[sliceindex][orbitindex][npoints-1].y);
+    int last = first + npoints - 1;
+    orbit_open = (s.x[first] != s.x[last]) || (s.y[first] != s.y[last]);
   }
   bool closed = (!orbit_empty) && (!orbit_open);
   return closed;
@@ -367,42 +391,53 @@ bool OrbitContainer::orbit_closed(int sliceindex, int orbitindex){
 
 bool OrbitContainer::simple_orbit_closed(int sliceindex){
   
-  int orbitnumber = orbitdata[sliceindex].size()-1;
-  int pointnumber = orbitdata[sliceindex][orbitnumber].size()-1;
-  bool closed = false;
-  if((get_first_orbitpoint(sliceindex).x == get_last_orbitpoint(sliceindex).x) &&
-    (get_first_orbitpoint(sliceindex).y == get_last_orbitpoint(sliceindex).y) && (pointnumber > 0)){ //only orbits containing more than one point can be closed
-    closed = true;
-  }
-  return closed;
+  const OrbitSlice& s = slices[sliceindex];
+  int first = s.offsets[s.offsets.size()-2];
+  int last = s.offsets.back() - 1;
+  return ((s.x[first] == s.x[last]) && (s.y[first] == s.y[last]) && (last > first)); //only orbits containing more than one point can be closed
 }
 
-void OrbitContainer::delete_empty_and_open_orbits(){
+void OrbitContainer::delete_empty_and_open_orbits(int sliceindex){
   
-  vector< vector< vector< OrbitPoint > > > goodorb; //use a new vector because erasing from a vector is extremely slow
+  //closed orbits are copied into exactly sized arrays, the arena is kept as spare for the next slice
+  OrbitSlice& s = slices[sliceindex];
+  int norbits = s.offsets.size() - 1;
+  int npoints = 0;
+  for(int n=0;n<norbits;n++){
+    if(orbit_closed(sliceindex, n)){
+      npoints += s.offsets[n+1] - s.offsets[n];
+    }
+  }
   
-  for(int i=0;i<nslices;i++){
-    vector<vector<OrbitPoint> > slice;
-    for(uint j=0;uint(j<orbitdata[i].size());j++){
-      bool orbit_ok = orbit_closed(i, j);
-      if(orbit_ok){
-	slice.push_back(orbitdata[i][j]);
-      }
+  OrbitSlice closed;
+  closed.offsets.assign(1, 0);
+  closed.x.reserve(npoints); closed.y.reserve(npoints);
+  closed.dE.reserve(npoints);
+  closed.i.reserve(npoints); closed.j.reserve(npoints); closed.ig.reserve(npoints); closed.jg.reserve(npoints);
+  for(int n=0;n<norbits;n++){
+    if(orbit_closed(sliceindex, n)){
+      int first = s.offsets[n], last = s.offsets[n+1];
+      closed.x.insert(closed.x.end(), s.x.begin() + first, s.x.begin() + last);
+      closed.y.insert(closed.y.end(), s.y.begin() + first, s.y.begin() + last);
+      closed.dE.insert(closed.dE.end(), s.dE.begin() + first, s.dE.begin() + last);
+      closed.i.insert(closed.i.end(), s.i.begin() + first, s.i.begin() + last);
+      closed.j.insert(closed.j.end(), s.j.begin() + first, s.j.begin() + last);
+      closed.ig.insert(closed.ig.end(), s.ig.begin() + first, s.ig.begin() + last);
+      closed.jg.insert(closed.jg.end(), s.jg.begin() + first, s.jg.begin() + last);
+      closed.offsets.push_back(closed.x.size());
     }
-    goodorb.push_back(slice);
   }
-  orbitdata = goodorb;
+  if(norbits > 0){ //the slice holds the arena only if new_orbit was called
+    swap(spares[omp_get_thread_num()], s);
+  }
+  s = move(closed);
 }
 
 void OrbitContainer::print_orbits(){
   
-  for(uint i=0;i<orbitdata.size();i++){
-    for(uint j=0;j<orbitdata[i].size();j++){
-      if(orbitdata[i][j].size() > 0){
-	for(uint k=0;k<orbitdata[i][j].size();k++){
-	  cout << orbitdata[i][j][k].x << " " << orbitdata[i][j][k].y << endl;
-	}
-      }
+  for(int i=0;i<nslices;i++){
+    for(uint n=0;n<slices[i].x.size();n++){
+      cout << slices[i].x[n] << " " << slices[i].y[n] << endl;
     }
   }
 }
@@ -410,14 +445,13 @@ void OrbitContainer::print_orbits(){
 void OrbitContainer::write_orbits(boost::filesystem::path filepath){
   
   boost::filesystem::ofstream filehandle(filepath);
-  for(uint i=0;i<orbitdata.size();i++){ //loop over slices
-    for(uint j=0;j<orbitdata[i].size();j++){ //loop over orbits
-      if(orbitdata[i][j].size() > 0){
-	for(uint k=0;k<orbitdata[i][j].size();k++){ //loop over points in orbit
+  for(int i=0;i<nslices;i++){ //loop over slices
+    const OrbitSlice& s = slices[i];
+    for(int j=0;j<get_orbitcount(i);j++){ //loop over orbits
+      if(s.offsets[j+1] > s.offsets[j]){
+	for(int k=s.offsets[j];k<s.offsets[j+1];k++){ //loop over points in orbit
 	  filehandle << boost::lexical_cast<string>(boost::format("% .8f % .8f %4i %4i %4i %4i") 
-	                                            % orbitdata[i][j][k].x % orbitdata[i][j][k].y % 
-	                                            orbitdata[i][j][k].i % orbitdata[i][j][k].j %
-	                                            orbitdata[i][j][k].ig % orbitdata[i][j][k].jg) << endl;
+	                                            % s.x[k] % s.y[k] % s.i[k] % s.j[k] % s.ig[k] % s.jg[k]) << endl;
 	}
 	filehandle << endl;
       }
@@ -427,32 +461,30 @@ void OrbitContainer::write_orbits(boost::filesystem::path filepath){
   filehandle.close();
 }
 
-int OrbitContainer::get_slicecount(){
-  
-  return orbitdata.size();
-}
-
-int OrbitContainer::get_orbitcount(int sliceindex){
+int OrbitContainer::get_slicecount() const{
   
-  return orbitdata[sliceindex].size();
+  return slices.size();
 }
 
-vector<OrbitPoint> OrbitContainer::get_orbit(int sliceindex, int orbitindex){
+int OrbitContainer::get_orbitcount(int sliceindex) const{
   
-  return orbitdata[sliceindex][orbitindex];
+  return slices[sliceindex].offsets.size() - 1;
 }
 
-void OrbitContainer::update_last_orbitpoint(int sliceindex, OrbitPoint p){
+OrbitView OrbitContainer::get_orbit(int sliceindex, int orbitindex) const{
   
-  int orbitnumber = orbitdata[sliceindex].size()-1;
-  orbitdata[sliceindex][orbitnumber].pop_back();
-  orbitdata[sliceindex][orbitnumber].push_back(p);
+  const OrbitSlice& s = slices[sliceindex];
+  int first = s.offsets[orbitindex];
+  OrbitView v;
+  v.npoints = s.offsets[orbitindex+1] - first;
+  v.x = s.x.data() + first;
+  v.y = s.y.data() + first;
+  v.dE = s.dE.data() + first;
+  return v;
 }
 
 bool OrbitContainer::last_orbit_empty(int sliceindex){
   
-  int orbitnumber = orbitdata[sliceindex].size()-1;
-  int pcount = orbitdata[sliceindex][orbitnumber].size();
-  
-  return (pcount < 1);
-}
\ No newline at end of file
+  const OrbitSlice& s = slices[sliceindex];
+  return (s.offsets.back() == s.offsets[s.offsets.size()-2]);
+}
@@ -20,6 +20,8 @@
 //orbit.hpp
 #include <cstdio>
 #include <vector>
+#include <cstdint>
+#include <omp.h>
 #include <boost/array.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/filesystem.hpp>
@@ -42,9 +44,21 @@ struct OrbitPoint{
   int jg;
   fptype x;
   fptype y;
-  fptype dEparallel;
-  fptype dEperpendicular;
-  int dir; //glancing direction
+  fptype dE; //magnitude of the energy gradient within the slice plane at the crossing
+};
+
+struct OrbitView{ //non-owning view of the points of one orbit, valid until the slice is modified
+  int npoints;
+  const fptype* x;
+  const fptype* y;
+  const fptype* dE;
+  int size() const {return npoints;}
+};
+
+struct OrbitSlice{ //all orbits of one slice in one arena of arrays, orbit n holds the points offsets[n] to offsets[n+1]-1
+  vector<int> offsets;
+  vector<fptype> x, y, dE;
+  vector<int> i, j, ig, jg; //grid indices of the point and the glanced point, only written out for debugging
 };
 
 class OrbitContainer{
@@ -52,36 +66,37 @@ class OrbitContainer{
     OrbitContainer();
     void set_slicecount(int n);
     void new_orbit(int sliceindex);
-    void add_orbitpoint(int sliceindex, OrbitPoint p);
+    void add_orbitpoint(int sliceindex, const OrbitPoint& p);
     bool orbit_closed(int sliceindex, int orbitindex);
     bool simple_orbit_closed(int sliceindex);
-    void delete_empty_and_open_orbits();
+    void delete_empty_and_open_orbits(int sliceindex);
     void print_orbits();
     void write_orbits(boost::filesystem::path filepath);
-    int get_slicecount();
-    int get_orbitcount(int sliceindex);
-    vector<OrbitPoint> get_orbit(int sliceindex, int orbitindex);
-    OrbitPoint get_first_orbitpoint(int sliceindex);
-    OrbitPoint get_last_orbitpoint(int sliceindex);
-    void update_last_orbitpoint(int sliceindex, OrbitPoint p);
+    int get_slicecount() const;
+    int get_orbitcount(int sliceindex) const;
+    OrbitView get_orbit(int sliceindex, int orbitindex) const;
     bool last_orbit_empty(int sliceindex);
   private:
     int nslices;
-    vector< vector< vector< OrbitPoint > > > orbitdata;
+    vector<OrbitSlice> slices; //different slices may be written by different threads
+    vector<OrbitSlice> spares; //arena of the last slice finished by each thread, its capacity is reused for the next slice
 };
 
-class OrbitFinder{
+class SliceTracer{ //stepper state of one slice, every thread traces whole slices with its own tracer
   public:
-    OrbitFinder(GlobalSettings& settings, SuperCell& sc);
-    OrbitContainer get_orbits();
-    OrbitContainer* get_orbits_pointer();
+    SliceTracer(int nksc_in, SuperCell& sc_in, OrbitContainer& orbitcont_in);
+    void trace(int k_in);
   private:
     int nksc;
-    boost::multi_array<fptype,3> energies;
-    boost::multi_array<fptype,4> kpoints;
-    boost::multi_array<bool,3> unchecked;
-    OrbitContainer orbitcont;
-    void start();
+    boost::multi_array<storetype,2> energies; //energies of the current slice
+    const SuperCellGrid& grid;
+    SuperCell& sc; //interpolates the energy gradient at the crossings
+    OrbitContainer& orbitcont; //only slice k is written
+    int nwords; //64 bit words per row of a bitplane
+    vector<uint64_t> inside; //bitplane of the current slice, set where the energy is not above the fermi energy
+    vector<uint64_t> visited; //bitplane of the current slice, set for every point the scan or the stepper has looked at
+    void fill_bitplanes();
+    void start(const int k_in);
     void stepper(const int i_in, const int j_in, const int k_in);
     void record_fs();
     inline void glance_north();
@@ -112,4 +127,14 @@ class OrbitFinder{
     int jp[6];  
 };
 
+class OrbitFinder{
+  public:
+    OrbitFinder(GlobalSettings& settings, SuperCell& sc);
+    OrbitContainer get_orbits();
+    OrbitContainer* get_orbits_pointer();
+  private:
+    int nksc;
+    OrbitContainer orbitcont;
+};
+
 #endif
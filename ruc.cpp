@@ -20,13 +20,11 @@
 //ruc.cpp
 #include "ruc.hpp"
 
-ReciprocalUnitCell::ReciprocalUnitCell(const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h_arr, const boost::multi_array<fptype, 3>& e_arr){
+ReciprocalUnitCell::ReciprocalUnitCell(const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h_arr, const boost::const_multi_array_ref<fptype, 3>& e_arr) : energies(e_arr){
   
   nk = nkpoints;
   h.resize(boost::extents[3][3]);
   h = h_arr;
-  energies.resize(boost::extents[nk[0]][nk[1]][nk[2]]);
-  energies = e_arr;
 }
 
 boost::array<int,3> ReciprocalUnitCell::get_nk(){
@@ -39,7 +37,62 @@ boost::multi_array<fptype, 2> ReciprocalUnitCell::get_h(){
   return h;
 }
 
-boost::multi_array<fptype,3> ReciprocalUnitCell::get_energies(){
+const boost::const_multi_array_ref<fptype,3>& ReciprocalUnitCell::get_energies(){
   
   return energies;
-}
\ No newline at end of file
+}
+
+shared_ptr<const vector<fptype> > ReciprocalUnitCell::get_tricubic_table(){
+  
+  long tablesize = long(nk[0])*nk[1]*nk[2]*64*sizeof(fptype);
+  if(!tricubictable && (tricubictablelimit > 0) && (tablesize <= tricubictablelimit)){
+    TriCubicInterpolator ip(energies, 1.0, nk);
+    ip.precompute_coefficients();
+    tricubictable = ip.get_coefficient_table();
+  }
+  return tricubictable;
+}
+
+void ReciprocalUnitCell::prepare_interpolator(int ip){
+  
+  switch(ip){
+    case 0: get_linear_interpolator(); break;
+    case 1: get_cubic_interpolator(); break;
+    case 2: get_spectral_interpolator(); break;
+    case 3: get_bspline_interpolator(); break;
+  }
+}
+
+shared_ptr<const TriLinearInterpolator> ReciprocalUnitCell::get_linear_interpolator(){
+  
+  if(!linearip){
+    linearip = make_shared<const TriLinearInterpolator>(energies, nk);
+  }
+  return linearip;
+}
+
+shared_ptr<const TriCubicInterpolator> ReciprocalUnitCell::get_cubic_interpolator(){
+  
+  if(!cubicip){
+    TriCubicInterpolator* ip = new TriCubicInterpolator(energies, 1.0, nk);
+    ip->set_coefficient_table(get_tricubic_table());
+    cubicip.reset(ip);
+  }
+  return cubicip;
+}
+
+shared_ptr<const SpectralInterpolator> ReciprocalUnitCell::get_spectral_interpolator(){
+  
+  if(!spectralip){
+    spectralip = make_shared<const SpectralInterpolator>(energies, nk);
+  }
+  return spectralip;
+}
+
+shared_ptr<const BSplineInterpolator> ReciprocalUnitCell::get_bspline_interpolator(){
+  
+  if(!bsplineip){
+    bsplineip = make_shared<const BSplineInterpolator>(energies, nk);
+  }
+  return bsplineip;
+}
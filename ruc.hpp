@@ -18,24 +18,42 @@
 */
 
 //ruc.hpp
+#include <memory>
+#include <vector>
 #include <boost/array.hpp>
 #include <boost/multi_array.hpp>
 
 #include "typedefs.hpp"
+#include "tricubic.hpp"
+#include "trilinear.hpp"
+#include "spectral.hpp"
+#include "bspline.hpp"
 
 #ifndef RECIPROCAL_UNIT_CELL_H
 #define RECIPROCAL_UNIT_CELL_H
 
 class ReciprocalUnitCell{
   public:
-    ReciprocalUnitCell(const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h_arr, const boost::multi_array<fptype, 3>& e_arr);
+    ReciprocalUnitCell(const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h_arr, const boost::const_multi_array_ref<fptype, 3>& e_arr);
     boost::array<int,3> get_nk();
     boost::multi_array<fptype, 2> get_h();
-    boost::multi_array<fptype,3> get_energies();
+    const boost::const_multi_array_ref<fptype,3>& get_energies();
+    shared_ptr<const vector<fptype> > get_tricubic_table();
+    void prepare_interpolator(int ip); //must be called before super cells are built on several threads
+    shared_ptr<const TriLinearInterpolator> get_linear_interpolator();
+    shared_ptr<const TriCubicInterpolator> get_cubic_interpolator();
+    shared_ptr<const SpectralInterpolator> get_spectral_interpolator();
+    shared_ptr<const BSplineInterpolator> get_bspline_interpolator();
   private:
     boost::array<int, 3> nk; //number is number of entries
     boost::multi_array<fptype, 2> h; //number is number of dimensions, number of elements must be set in constructor
-    boost::multi_array<fptype, 3> energies;
+    boost::const_multi_array_ref<fptype, 3> energies; //non-owning view on the energies held by the input file
+    shared_ptr<const vector<fptype> > tricubictable; //calculated on first use and shared by all super cells of this band
+    //interpolators are built on first use, every super cell of this band evaluates a copy sharing their data
+    shared_ptr<const TriLinearInterpolator> linearip;
+    shared_ptr<const TriCubicInterpolator> cubicip;
+    shared_ptr<const SpectralInterpolator> spectralip;
+    shared_ptr<const BSplineInterpolator> bsplineip;
 };
 
 #endif
@@ -20,37 +20,193 @@
 //sc.cpp 
 #include "sc.hpp"
 
+SuperCellGrid::SuperCellGrid(){
+  
+  nksc = 0;
+}
+
+SuperCellGrid::SuperCellGrid(const boost::multi_array<fptype,1>& kvals_in, const Eigen::Matrix<fptype,3,3>& anglematrix, const Eigen::Matrix<fptype,3,3>& transformmatrix, const boost::array<int,3>& nk_in){
+  
+  nksc = kvals_in.size();
+  kvals.assign(kvals_in.begin(), kvals_in.end());
+  nk = nk_in;
+  
+  //apart from the periodic reduction the interpolator indices are a linear function of the k-point
+  jacobian = transformmatrix * anglematrix;
+  for(int l=0;l<3;l++){
+    jacobian.row(l) *= (nk[l]-1);
+  }
+}
+
+Eigen::Matrix<fptype,3,1> SuperCellGrid::kpoint(int i, int j, int k) const{
+  
+  Eigen::Matrix<fptype,3,1> vec;
+  vec << kvals[i], kvals[j], kvals[k];
+  return vec;
+}
+
+Eigen::Matrix<fptype,3,1> SuperCellGrid::kpoint_ip_indices(const Eigen::Matrix<fptype,3,1>& kpoint) const{
+  
+  Eigen::Matrix<fptype,3,1> vec = jacobian * kpoint;
+  for(int l=0;l<3;l++){
+    vec(l,0) = fmod(vec(l,0), nk[l]-1);
+    if(vec(l,0) < 0){
+      vec(l,0) += nk[l]-1;
+    }
+  }
+  return vec;
+}
+
+Eigen::Matrix<fptype,3,1> SuperCellGrid::ip_indices_step(int axis) const{
+  
+  return jacobian.col(axis) * ((kvals[nksc-1] - kvals[0])/(nksc-1)); //the k-points are evenly spaced
+}
+
+template <class Interpolator> void SuperCell::calc_row_energies(Interpolator& ip, const Eigen::Matrix<fptype,3,1>& origin, const Eigen::Matrix<fptype,3,1>& step, SuperCellRow& row, storetype* out, long outstride){
+  
+  //rotation, periodic reduction and scaling to interpolator indices in one sweep over the row
+  fptype* coords[3] = {row.x.data(), row.y.data(), row.z.data()};
+  for(int l=0;l<3;l++){
+    fptype period = grid.ip_period(l), start = origin(l,0), delta = step(l,0);
+    fptype* c = coords[l];
+    for(int n=0;n<nksc;n++){
+      fptype v = fmod(start + n*delta, period); //multiplied instead of accumulated, so rounding errors do not add up along the row
+      c[n] = (v < 0) ? v + period : v;
+    }
+  }
+  ip.evaluate(row.x.data(), row.y.data(), row.z.data(), row.energies.data(), nksc);
+  for(int n=0;n<nksc;n++){
+    out[n*outstride] = row.energies[n];
+  }
+}
+
+//the rows are distributed over the threads with the schedule set in OMP_SCHEDULE, every thread evaluates its own copy of the interpolator
+//rows run along the second index as in calc_slice_energies, so every k-point gets the same energy with and without streaming
+template <class Interpolator> void SuperCell::calc_sc_energies(Interpolator& ip){
+  
+  Eigen::Matrix<fptype,3,1> step = grid.ip_indices_step(1);
+  #pragma omp parallel
+  {
+    Interpolator localip(ip);
+    SuperCellRow row(nksc);
+    #pragma omp for schedule(runtime)
+    for(int i=0;i<nksc;i++){ //one slab of nksc rows per iteration
+      for(int k=0;k<nksc;k++){
+	calc_row_energies(localip, grid.ip_indices_unreduced(i, 0, k), step, row, &energies[i][0][k], nksc);
+      }
+    }
+  }
+}
+
+template <class Interpolator> void SuperCell::calc_slice_energies(Interpolator& ip, int k, boost::multi_array<storetype,2>& slice){
+  
+  Eigen::Matrix<fptype,3,1> step = grid.ip_indices_step(1); //rows along the second index
+  #pragma omp parallel
+  {
+    Interpolator localip(ip);
+    SuperCellRow row(nksc);
+    #pragma omp for schedule(runtime)
+    for(int i=0;i<nksc;i++){
+      calc_row_energies(localip, grid.ip_indices_unreduced(i, 0, k), step, row, slice[i].origin(), 1);
+    }
+  }
+}
+
+template <class Interpolator> Eigen::Matrix<fptype,3,1> SuperCell::calc_gradient(Interpolator& ip, const Eigen::Matrix<fptype,3,1>& kpoint){
+  
+  Eigen::Matrix<fptype,3,1> vec = grid.kpoint_ip_indices(kpoint), gradient;
+  ip(vec(0,0), vec(1,0), vec(2,0), gradient.data()); //gradient with respect to the interpolator indices
+  return grid.get_jacobian().transpose() * gradient; //chain rule
+}
+
 SuperCell::SuperCell(GlobalSettings& settings, ReciprocalUnitCell& ruc){
   
   nksc = settings.nksc;
   phi = settings.phi;
   theta = settings.theta;
   nsc = settings.nsc;
+  streaming = (settings.go == 0); //the graphical output needs the whole cube
   
-  kpoints.resize(boost::extents[nksc][nksc][nksc][3]);
-  kpoints_rucframe_reduced.resize(boost::extents[nksc][nksc][nksc][3]);
-  kpoints_ip_indices.resize(boost::extents[nksc][nksc][nksc][3]);
-  energies.resize(boost::extents[nksc][nksc][nksc]);
+  if(!streaming){
+    energies.resize(boost::extents[nksc][nksc][nksc]);
+  }
   
   calc_length_longest_ruc_vector(ruc.get_h());
-  calc_sc_kgrid(nksc);
-  calc_sc_kgrid_rucframe_reduced(ruc);
-  calc_sc_kgrid_ip_indices(ruc);
+  calc_sc_kgrid(ruc);
   
   if(settings.ip == 0){
-    TriLinearInterpolator ip(ruc.get_energies(), ruc.get_nk());
-    calc_sc_energies_linear(ip);
+    linearip.reset(new TriLinearInterpolator(*ruc.get_linear_interpolator()));
+    if(!streaming){
+      calc_sc_energies(*linearip);
+    }
   }
   else if(settings.ip == 1){
-    fptype spacing = 1.0;
-    TriCubicInterpolator ip(ruc.get_energies(), spacing, ruc.get_nk());
-    calc_sc_energies_cubic(ip);
+    cubicip.reset(new TriCubicInterpolator(*ruc.get_cubic_interpolator()));
+    cubicips.assign(omp_get_max_threads(), *cubicip);
+    if(!streaming){
+      calc_sc_energies(*cubicip);
+    }
+  }
+  else if(settings.ip == 2){
+    spectralip.reset(new SpectralInterpolator(*ruc.get_spectral_interpolator()));
+    if(!streaming){
+      calc_sc_energies(*spectralip);
+    }
+  }
+  else if(settings.ip == 3){
+    bsplineip.reset(new BSplineInterpolator(*ruc.get_bspline_interpolator()));
+    if(!streaming){
+      calc_sc_energies(*bsplineip);
+    }
   }
   else{
     cout << "Error. Interpolation Method not present." << endl;
   }
 }
 
+bool SuperCell::is_streaming(){
+  
+  return streaming;
+}
+
+void SuperCell::get_slice(int k, boost::multi_array<storetype,2>& slice){ //energies of all k-points with third index k
+  
+  slice.resize(boost::extents[nksc][nksc]);
+  if(!streaming){
+    for(int i=0;i<nksc;i++){
+      for(int j=0;j<nksc;j++){
+	slice[i][j] = energies[i][j][k];
+      }
+    }
+  }
+  else if(linearip){
+    calc_slice_energies(*linearip, k, slice);
+  }
+  else if(cubicip){
+    calc_slice_energies(*cubicip, k, slice);
+  }
+  else if(spectralip){
+    calc_slice_energies(*spectralip, k, slice);
+  }
+  else if(bsplineip){
+    calc_slice_energies(*bsplineip, k, slice);
+  }
+}
+
+Eigen::Matrix<fptype,3,1> SuperCell::get_gradient(const Eigen::Matrix<fptype,3,1>& kpoint){
+  
+  if(linearip){
+    return calc_gradient(*linearip, kpoint);
+  }
+  else if(cubicip){
+    return calc_gradient(cubicips[omp_get_thread_num()], kpoint);
+  }
+  else if(spectralip){
+    return calc_gradient(*spectralip, kpoint);
+  }
+  return calc_gradient(*bsplineip, kpoint);
+}
+
 void SuperCell::calc_anglematrix(){
   
   Eigen::Matrix<fptype,3,3> m_mat;
@@ -106,127 +262,33 @@ void SuperCell::calc_length_longest_ruc_vector(const boost::multi_array<fptype,
   longest_rucvec_length = result;
 }
 
-void SuperCell::calc_sc_kgrid(int nksc){
+void SuperCell::calc_sc_kgrid(ReciprocalUnitCell& ruc){
   
   boost::multi_array<fptype,1> kvals;
   kvals.resize(boost::extents[nksc]);
   for(int i=0;i<nksc;i++){
-    kvals[i] = float(i)/(nksc-1) * longest_rucvec_length *nsc - longest_rucvec_length; //these are super cell k-space coordinates
+    kvals[i] = fptype(double(i)/(nksc-1) * longest_rucvec_length *nsc - longest_rucvec_length); //these are super cell k-space coordinates, rounded once
   }
   
-  for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	kpoints[i][j][k][0] = kvals[i];
-	kpoints[i][j][k][1] = kvals[j];
-	kpoints[i][j][k][2] = kvals[k];
-      }
-    }
-  }
-}
-
-void SuperCell::calc_sc_kgrid_rucframe_reduced(ReciprocalUnitCell& ruc){
-  
-  Eigen::Matrix<fptype,3,1> vec;
-  
   calc_anglematrix();
   calc_transformmatrix(ruc.get_h());
-  
-  for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	for(int l=0;l<3;l++){
-	  vec(l,0) = kpoints[i][j][k][l];
-	}
-	vec = anglematrix * vec;
-	vec = shift_to_ruc(vec);
-	for(int l=0;l<3;l++){
-	  kpoints_rucframe_reduced[i][j][k][l] = vec(l,0); //these are reduced coordinates in ruc
-	}
-      }
-    }
-  }
-}
-
-void SuperCell::calc_sc_kgrid_ip_indices(ReciprocalUnitCell& ruc){
-  
-  boost::array<int,3> nk;
-  nk = ruc.get_nk();
-  
-  for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	for(int l=0;l<3;l++){
-	  kpoints_ip_indices[i][j][k][l] = kpoints_rucframe_reduced[i][j][k][l] * (nk[l]-1);
-	}
-      }
-    }
-  }
-}
-
-
-void SuperCell::calc_sc_energies_linear(TriLinearInterpolator& ip){
-  
-  fptype x,y,z;
-  
-  for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	x = kpoints_ip_indices[i][j][k][0];
-	y = kpoints_ip_indices[i][j][k][1];
-	z = kpoints_ip_indices[i][j][k][2];
-	energies[i][j][k] = ip(x,y,z);
-      }
-    }
-  }
-}
-  
-void SuperCell::calc_sc_energies_cubic(TriCubicInterpolator& ip){
-  
-  fptype x,y,z;
-  
-  for(int i=0;i<nksc;i++){
-    for(int j=0;j<nksc;j++){
-      for(int k=0;k<nksc;k++){
-	x = kpoints_ip_indices[i][j][k][0];
-	y = kpoints_ip_indices[i][j][k][1];
-	z = kpoints_ip_indices[i][j][k][2];
-	energies[i][j][k] = ip(x,y,z);
-      }
-    }
-  }
+  grid = SuperCellGrid(kvals, anglematrix, transformmatrix, ruc.get_nk());
 }
 
-Eigen::Matrix<fptype,3,1> SuperCell::shift_to_ruc(Eigen::Matrix<fptype,3,1> vec){
   
-  vec = transformmatrix * vec;
-  for(int i=0;i<3;i++){
-    vec(i,0) = fmod(vec(i,0),1);
-    if(vec(i,0) < 0){
-      vec(i,0) += 1.0;
-    }
-  } 
-  return vec;
-}
-
-boost::multi_array<fptype,3> SuperCell::get_energies(){
+boost::multi_array<storetype,3> SuperCell::get_energies(){
   
   return energies;
 }
 
-boost::multi_array<fptype,3> * SuperCell::get_energies_pointer(){
+boost::multi_array<storetype,3> * SuperCell::get_energies_pointer(){
   
   return &energies;
 }
 
-boost::multi_array<fptype,4> SuperCell::get_kpoints(){
-  
-  return kpoints;
-}
-
-boost::multi_array<fptype,4> * SuperCell::get_kpoints_pointer(){
+const SuperCellGrid& SuperCell::get_grid(){
   
-  return &kpoints;
+  return grid;
 }
 
 fptype SuperCell::get_sc_length(){
@@ -19,6 +19,8 @@
 
 //sc.hpp
 #include <iostream>
+#include <memory>
+#include <omp.h>
 #include <boost/array.hpp>
 #include <boost/multi_array.hpp>
 #include <Eigen/Dense>
@@ -28,40 +30,71 @@
 #include "ruc.hpp"
 #include "tricubic.hpp"
 #include "trilinear.hpp"
+#include "spectral.hpp"
+#include "bspline.hpp"
 
 #ifndef SUPER_CELL_H
 #define SUPER_CELL_H
 
 using namespace std;
 
+class SuperCellGrid{ //k-point coordinates of the super cell, computed on demand from the separable grid values
+  public:
+    SuperCellGrid();
+    SuperCellGrid(const boost::multi_array<fptype,1>& kvals_in, const Eigen::Matrix<fptype,3,3>& anglematrix, const Eigen::Matrix<fptype,3,3>& transformmatrix_in, const boost::array<int,3>& nk_in);
+    int get_nksc() const {return nksc;}
+    fptype kval(int i) const {return kvals[i];} //super cell k-space coordinate of grid index i along any axis
+    Eigen::Matrix<fptype,3,1> kpoint(int i, int j, int k) const;
+    Eigen::Matrix<fptype,3,1> kpoint_ip_indices(const Eigen::Matrix<fptype,3,1>& kpoint) const; //any super cell k-point
+    Eigen::Matrix<fptype,3,1> ip_indices_unreduced(int i, int j, int k) const {return jacobian*kpoint(i, j, k);} //before the periodic reduction
+    Eigen::Matrix<fptype,3,1> ip_indices_step(int axis) const; //change of the unreduced indices per grid step along axis
+    fptype ip_period(int l) const {return nk[l]-1;} //period of the interpolator index l
+    const Eigen::Matrix<fptype,3,3>& get_jacobian() const {return jacobian;} //derivative of the interpolator indices with respect to the super cell k-point
+  private:
+    int nksc;
+    vector<fptype> kvals;
+    Eigen::Matrix<fptype,3,3> jacobian;
+    boost::array<int,3> nk;
+};
+
+struct SuperCellRow{ //scratch arrays for one row of k-points
+  vector<fptype> x, y, z, energies;
+  SuperCellRow(int n) : x(n), y(n), z(n), energies(n) {}
+};
+
 class SuperCell{
   public:
     SuperCell(GlobalSettings& settings, ReciprocalUnitCell& ruc);
-    boost::multi_array<fptype,3> get_energies();
-    boost::multi_array<fptype,3> * get_energies_pointer();
-    boost::multi_array<fptype,4> get_kpoints();
-    boost::multi_array<fptype,4> * get_kpoints_pointer();
+    bool is_streaming();
+    void get_slice(int k, boost::multi_array<storetype,2>& slice);
+    boost::multi_array<storetype,3> get_energies();
+    boost::multi_array<storetype,3> * get_energies_pointer();
+    const SuperCellGrid& get_grid();
+    Eigen::Matrix<fptype,3,1> get_gradient(const Eigen::Matrix<fptype,3,1>& kpoint); //energy gradient in super cell k-space coordinates, may be called by several threads
     fptype get_sc_length();
   private:
     int nksc;
     float nsc;
     fptype phi, theta;
     fptype longest_rucvec_length;
-    boost::multi_array<fptype,4> kpoints;
-    boost::multi_array<fptype,4> kpoints_rucframe_reduced;
-    boost::multi_array<fptype,4> kpoints_ip_indices;
-    boost::multi_array<fptype,3> energies;
+    SuperCellGrid grid;
+    bool streaming; //slices are interpolated on request and the full energy cube is never allocated
+    boost::multi_array<storetype,3> energies;
+    unique_ptr<TriLinearInterpolator> linearip;
+    unique_ptr<TriCubicInterpolator> cubicip;
+    vector<TriCubicInterpolator> cubicips; //one copy per thread for the gradients, the voxel cache of cubicip is never modified
+    unique_ptr<SpectralInterpolator> spectralip;
+    unique_ptr<BSplineInterpolator> bsplineip;
     Eigen::Matrix<fptype,3,3> anglematrix; //T^-1
     Eigen::Matrix<fptype,3,3> transformmatrix;  //M^-1
     void calc_anglematrix();
     void calc_transformmatrix(const boost::multi_array<fptype,2>& h);
     void calc_length_longest_ruc_vector(const boost::multi_array<fptype,2>& h);
-    void calc_sc_kgrid(const int nksc);
-    void calc_sc_kgrid_rucframe_reduced(ReciprocalUnitCell& ruc);
-    void calc_sc_kgrid_ip_indices(ReciprocalUnitCell& ruc);
-    void calc_sc_energies_linear(TriLinearInterpolator& ip);
-    void calc_sc_energies_cubic(TriCubicInterpolator& ip);
-    Eigen::Matrix<fptype,3,1> shift_to_ruc(Eigen::Matrix<fptype,3,1> vec);
+    void calc_sc_kgrid(ReciprocalUnitCell& ruc);
+    template <class Interpolator> void calc_row_energies(Interpolator& ip, const Eigen::Matrix<fptype,3,1>& origin, const Eigen::Matrix<fptype,3,1>& step, SuperCellRow& row, storetype* out, long outstride);
+    template <class Interpolator> void calc_sc_energies(Interpolator& ip);
+    template <class Interpolator> void calc_slice_energies(Interpolator& ip, int k, boost::multi_array<storetype,2>& slice);
+    template <class Interpolator> Eigen::Matrix<fptype,3,1> calc_gradient(Interpolator& ip, const Eigen::Matrix<fptype,3,1>& kpoint);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#
+# Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+#
+# This file is part of dhva.
+#
+# dhva is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# dhva is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with dhva. If not, see <http://www.gnu.org/licenses/>.
+#
+
+#script for comparing run-time and resulting frequencies of the interpolators of dhva
+import subprocess
+import sys
+import time
+import glob
+import os
+
+def read_frequencies(filename, count):
+  
+  frequencies = []
+  for line in open(filename):
+    if line.startswith('#') or (len(line.split()) == 0):
+      continue
+    frequencies.append(float(line.split()[0]))
+  return sorted(frequencies)[:count]
+
+def main():
+  
+  filename = sys.argv[1] if len(sys.argv) > 1 else "data/input/example.bxsf"
+  inputinev = 1
+  nkscs = [100, 200, 400] #super cell sizes to compare
+  nsc = 4
+  phi = 0
+  theta = 0
+  maxkdiff = 0.05
+  maxfdiff = 0.01
+  minimumfreq = 10
+  ips = {0 : 'linear', 1 : 'cubic', 2 : 'spectral', 3 : 'B-spline'}
+  go = 0
+  
+  print('%-10s %6s %10s   %s' % ('ip', 'nksc', 'time [s]', 'lowest frequencies [T]'))
+  for nksc in nkscs:
+    for ip in sorted(ips.keys()):
+      command = './dhva %s %i %i %f %f %f %f %f %f %i %i' % (filename, inputinev, nksc, nsc, phi, theta, maxkdiff, maxfdiff, minimumfreq, ip, go)
+      start = time.time()
+      subprocess.run(command.split(), stdout=subprocess.DEVNULL)
+      elapsed = time.time() - start
+      
+      #the newest output file belongs to this run
+      outputs = glob.glob('data/%s.%i_*_%i.out' % (os.path.basename(filename), nksc, ip))
+      frequencies = read_frequencies(max(outputs, key=os.path.getmtime), 3) if outputs else []
+      print('%-10s %6i %10.2f   %s' % (ips[ip], nksc, elapsed, ' '.join(['%.1f' % f for f in frequencies])))
+  
+  return 0
+  
+main()
@@ -22,11 +22,60 @@ import numpy as np
 import sys
 from mayavi import mlab
 
+def read_occupancy(filename):
+  #reads the bit-packed occupancy volume written by dhva with go = 1 or go = 2
+  #returns the super cell length and a boolean array indexed [i][j][k], true outside of the fermi surface
+  data = np.fromfile(str(filename), dtype=np.uint8)
+  if(data[0:8].tobytes() != b'DHVAOCC1'):
+    raise ValueError('not an occupancy file: ' + str(filename))
+  nksc, encoding = [int(v) for v in np.frombuffer(data[8:16].tobytes(), dtype='<i4')]
+  sc_length = np.frombuffer(data[16:20].tobytes(), dtype='<f4')[0]
+  headersize = 32
+  nslice = nksc*nksc
+  volume = np.zeros((nksc, nslice), dtype=bool)
+  if(encoding == 0):
+    slicebytes = (nslice + 7)//8
+    bits = data[headersize:headersize + nksc*slicebytes].reshape(nksc, slicebytes)
+    #bit n of a byte holds k-point 8*byte + n, so the bits of each byte are reversed after unpacking
+    bits = np.unpackbits(bits, axis=1).reshape(nksc, slicebytes, 8)[:, :, ::-1].reshape(nksc, 8*slicebytes)
+    volume = bits[:, :nslice].astype(bool)
+  else:
+    offsets = [int(v) for v in np.frombuffer(data[headersize:headersize + 8*(nksc + 1)].tobytes(), dtype='<u8')]
+    start = headersize + 8*(nksc + 1)
+    for k in range(nksc):
+      runs = []
+      value = 0
+      shift = 0
+      for byte in data[start + offsets[k]:start + offsets[k+1]]:
+        value |= int(byte & 0x7f) << shift
+        shift += 7
+        if(byte < 0x80):
+          runs.append(value)
+          value = 0
+          shift = 0
+      bits = np.arange(len(runs)) % 2 == 1
+      volume[k] = np.repeat(bits, runs)
+  #slices of constant k are stored one after another
+  volume = volume.reshape(nksc, nksc, nksc).transpose(1, 2, 0)
+  return sc_length, volume
+
+def show_occupancy(filename):
+  sc_length, volume = read_occupancy(filename)
+  n = volume.shape[0]
+  x,y,z = np.mgrid[0:sc_length:n*1j,0:sc_length:n*1j,0:sc_length:n*1j]
+  src = mlab.pipeline.scalar_field(x,y,z,volume.astype(float))
+  mlab.pipeline.iso_surface(src, contours=[0.5], color=(1,0,0))
+  return sc_length
+
 def main():
   if(2 <= len(sys.argv)):
     filenames = sys.argv[1:]
     mlab.figure(bgcolor=(1,1,1), fgcolor=(0,0,0))
     for filename in filenames:
+      if(str(filename).endswith('.occ')):
+        sc_length = show_occupancy(filename)
+        a = b = c = np.array([sc_length, sc_length, sc_length])
+        continue
       filehandle = open(str(filename), 'r')
       lines = filehandle.readlines()
       filehandle.close()
@@ -73,6 +122,9 @@ def main():
     mlab.outline() #draws box
     mlab.show() 
   else:
-    print 'Wrong number of input arguments.'
-    print 'Usage: python fs3d.py input.bxsf'
-main()
+    print('Wrong number of input arguments.')
+    print('Usage: python fs3d.py input.bxsf')
+    print('       python fs3d.py output.occ')
+
+if(__name__ == '__main__'):
+  main()
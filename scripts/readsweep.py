@@ -0,0 +1,52 @@
+#
+# Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+#
+# This file is part of dhva.
+#
+# dhva is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# dhva is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with dhva. If not, see <http://www.gnu.org/licenses/>.
+#
+
+#script for reading the results of a sweep written by dhva into a single file
+import sys
+import numpy as np
+
+headertype = np.dtype([('magic', 'S8'), ('headersize', '<i4'), ('recordsize', '<i4'), ('inputhash', '<u8'),
+                       ('nksc', '<i4'), ('nsc', '<f4'), ('maxkdiff', '<f4'), ('maxfreqdiff', '<f4'),
+                       ('minimumfreq', '<f4'), ('ip', '<i4'), ('inputname', 'S208')])
+
+recordtype = np.dtype([('phi', '<f4'), ('theta', '<f4'), ('band', '<i4'), ('f', '<f4'), ('fsdev', '<f4'),
+                       ('m', '<f4'), ('msdev', '<f4'), ('x', '<f4'), ('xsdev', '<f4'), ('y', '<f4'),
+                       ('ysdev', '<f4'), ('z', '<f4'), ('zsdev', '<f4'), ('n', '<i4'), ('reserved', '<i4', 2)])
+
+def read_sweep(filename):
+  #returns the header and all records, the records are memory mapped and not read into memory
+  header = np.fromfile(filename, dtype=headertype, count=1)[0]
+  if(header['magic'] != b'DHVASWP1'):
+    raise IOError('%s is not a dhva sweep file.' % filename)
+  records = np.memmap(filename, dtype=recordtype, mode='r', offset=int(header['headersize']))
+  return header, records
+
+def main():
+  if(2 == len(sys.argv)):
+    header, records = read_sweep(sys.argv[1])
+    print('# input : %s (hash %016x)' % (header['inputname'].decode(), header['inputhash']))
+    print('# nksc : %i, nsc : %f, maxkdiff : %f, maxfreqdiff : %f, minimumfreq : %f, ip : %i' % (header['nksc'], header['nsc'], header['maxkdiff'], header['maxfreqdiff'], header['minimumfreq'], header['ip']))
+    print('#Phi, Theta, Band, Freq [T], SdevFreq [T], M [m_e], SdevM [m_e], X [0...1], Y, Z, Number of copies')
+    for r in np.sort(records, order=['phi', 'theta', 'band', 'f']):
+      print('%f %f %i %5.1f %5.2f %f %f %f %f %f %i' % (r['phi'], r['theta'], r['band'], r['f'], r['fsdev'], r['m'], r['msdev'], r['x'], r['y'], r['z'], r['n']))
+  else:
+    print('Wrong number of input arguments.')
+    print('Usage: python readsweep.py sweepfile')
+    
+main()
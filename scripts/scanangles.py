@@ -22,25 +22,24 @@ import subprocess
 
 def main():
   
-  angles = range(-90,91,5) #sets the range of angles to scan
+  phimin, phimax, phistep = -90, 90, 5 #sets the range of angles to scan
   
   filename = "data/input/example.bxsf"
   inputinev = 1
   nksc = 400 #number of k-points along one side of the super cell
   nsc = 4 #number of reciprocal unit cells along one side of the super cell
-  phi = 90 
-  theta = 90
+  theta = 90 #we scan a range of phi angles with fixed theta
   maxkdiff = 1.0 #maximum k-space difference for center coordinates of orbits in one sheet 
   maxfdiff = 0.01 #maximum frequency difference among neighbouring orbits in one sheet
   minimumfreq = 50 #minimum frequency in tesla
   ip = 1 #interpolation method, 0==linear, 1==cubic
-  go = 0 #graphical output, 0==no, 1==yes
+  sweepfile = "data/scan.sweep" #all results are appended to this file, read it with readsweep.py
   
-  for an in angles:
-    phi = an #we scan a range of phi angles with fixed theta
-    command = './dhva %s %i %i %f %f %f %f %f %f %i %i' % (filename, inputinev, nksc, nsc, phi, theta, maxkdiff, maxfdiff, minimumfreq, ip, go) 
-    p = subprocess.Popen(command.split()) 
-    p.wait()
+  #the input file is read and the interpolator is built once, all angles are calculated in one process
+  angles = '%f:%f:%f,%f' % (phimin, phimax, phistep, theta)
+  command = './dhva sweep %s %i %i %f %s %f %f %f %i %s' % (filename, inputinev, nksc, nsc, angles, maxkdiff, maxfdiff, minimumfreq, ip, sweepfile) 
+  p = subprocess.Popen(command.split()) 
+  p.wait()
     
   return 0
   
@@ -0,0 +1,197 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//separable.hpp
+#include <cmath>
+
+#include "typedefs.hpp"
+#include "grid.hpp"
+#include "simd.hpp"
+
+#ifndef SEPARABLE_CUBIC_H
+#define SEPARABLE_CUBIC_H
+
+//weights of the four grid points i-1, i, i+1, i+2 around a point i+t with 0 <= t < 1
+struct CatmullRomWeights{ //interpolating, equals cubic Hermite splines with finite difference derivatives
+  static inline void weights(fptype t, fptype* w){
+    w[0] = t*((2 - t)*t - 1)/2;
+    w[1] = (t*t*(3*t - 5) + 2)/2;
+    w[2] = t*((4 - 3*t)*t + 1)/2;
+    w[3] = t*t*(t - 1)/2;
+  }
+  static inline void derivatives(fptype t, fptype* dw){
+    dw[0] = (t*(4 - 3*t) - 1)/2;
+    dw[1] = t*(9*t - 10)/2;
+    dw[2] = (t*(8 - 9*t) + 1)/2;
+    dw[3] = t*(3*t - 2)/2;
+  }
+#ifdef DHVA_SIMD_WIDTH
+  static inline void weights(SimdVector::real t, SimdVector::real* w){
+    typedef SimdVector V;
+    V::real one = V::set1(1), two = V::set1(2), three = V::set1(3), half = V::set1(0.5);
+    V::real tt = V::mul(t, t), three_t = V::mul(three, t);
+    w[0] = V::mul(V::mul(t, V::sub(V::mul(V::sub(two, t), t), one)), half);
+    w[1] = V::mul(V::add(V::mul(tt, V::sub(three_t, V::set1(5))), two), half);
+    w[2] = V::mul(V::mul(t, V::add(V::mul(V::sub(V::set1(4), three_t), t), one)), half);
+    w[3] = V::mul(V::mul(tt, V::sub(t, one)), half);
+  }
+#endif
+};
+
+struct CubicBSplineWeights{ //approximating, the grid has to hold prefiltered spline coefficients
+  static inline void weights(fptype t, fptype* w){
+    fptype s = 1 - t;
+    w[0] = s*s*s/6;
+    w[1] = (3*t*t*(t - 2) + 4)/6;
+    w[2] = (3*t*(1 + t - t*t) + 1)/6;
+    w[3] = t*t*t/6;
+  }
+  static inline void derivatives(fptype t, fptype* dw){
+    fptype s = 1 - t;
+    dw[0] = -s*s/2;
+    dw[1] = t*(3*t - 4)/2;
+    dw[2] = (t*(2 - 3*t) + 1)/2;
+    dw[3] = t*t/2;
+  }
+#ifdef DHVA_SIMD_WIDTH
+  static inline void weights(SimdVector::real t, SimdVector::real* w){
+    typedef SimdVector V;
+    V::real one = V::set1(1), three = V::set1(3), six = V::set1(6);
+    V::real s = V::sub(one, t), tt = V::mul(t, t); //same operation order as the scalar weights
+    w[0] = V::div(V::mul(V::mul(s, s), s), six);
+    w[1] = V::div(V::add(V::mul(V::mul(V::mul(three, t), t), V::sub(t, V::set1(2))), V::set1(4)), six);
+    w[2] = V::div(V::add(V::mul(V::mul(three, t), V::sub(V::add(one, t), tt)), one), six);
+    w[3] = V::div(V::mul(tt, t), six);
+  }
+#endif
+};
+
+//sum over the 4x4x4 grid points around (x,y,z) given in grid spacings, weighted by products of one weight per axis
+template <class Weights> inline fptype separable_cubic(const InterpolationGrid& grid, fptype x, fptype y, fptype z){
+  
+  int xi = (int)floor(x), yi = (int)floor(y), zi = (int)floor(z);
+  fptype wx[4], wy[4], wz[4];
+  Weights::weights(x - xi, wx);
+  Weights::weights(y - yi, wy);
+  Weights::weights(z - zi, wz);
+  
+  fptype result = 0;
+  for(int a=0;a<4;a++){
+    fptype sa = 0;
+    for(int b=0;b<4;b++){
+      fptype sb = 0;
+      for(int c=0;c<4;c++){
+	sb += wz[c]*grid(xi-1+a, yi-1+b, zi-1+c); //the grid wraps the indices periodically
+      }
+      sa += wy[b]*sb;
+    }
+    result += wx[a]*sa;
+  }
+  return result;
+}
+
+//same sum together with its gradient with respect to x, y and z in grid spacings
+template <class Weights> inline fptype separable_cubic(const InterpolationGrid& grid, fptype x, fptype y, fptype z, fptype* gradient){
+  
+  int xi = (int)floor(x), yi = (int)floor(y), zi = (int)floor(z);
+  fptype wx[4], wy[4], wz[4], dwx[4], dwy[4], dwz[4];
+  Weights::weights(x - xi, wx);
+  Weights::weights(y - yi, wy);
+  Weights::weights(z - zi, wz);
+  Weights::derivatives(x - xi, dwx);
+  Weights::derivatives(y - yi, dwy);
+  Weights::derivatives(z - zi, dwz);
+  
+  fptype result = 0, gx = 0, gy = 0, gz = 0;
+  for(int a=0;a<4;a++){
+    fptype sa = 0, sady = 0, sadz = 0;
+    for(int b=0;b<4;b++){
+      fptype sb = 0, sbdz = 0;
+      for(int c=0;c<4;c++){
+	fptype value = grid(xi-1+a, yi-1+b, zi-1+c);
+	sb += wz[c]*value;
+	sbdz += dwz[c]*value;
+      }
+      sa += wy[b]*sb;
+      sady += dwy[b]*sb;
+      sadz += wy[b]*sbdz;
+    }
+    result += wx[a]*sa;
+    gx += dwx[a]*sa;
+    gy += wx[a]*sady;
+    gz += wx[a]*sadz;
+  }
+  gradient[0] = gx;
+  gradient[1] = gy;
+  gradient[2] = gz;
+  return result;
+}
+
+//n points at once, the coordinates are multiplied by scale to obtain grid spacings, same result as separable_cubic
+template <class Weights> void separable_cubic(const InterpolationGrid& grid, fptype scale, const fptype* x, const fptype* y, const fptype* z, fptype* result, int n){
+  
+  int p = 0;
+#if defined(DHVA_SIMD_WIDTH) && !defined(DHVA_BRICKED_GRID)
+  typedef SimdVector V;
+  const fptype* base = grid.get_data();
+  int n2 = grid.get_n2(), n3 = grid.get_n3();
+  V::real vscale = V::set1(scale), one = V::set1(1);
+  V::real xmax = V::set1(grid.get_n1() - 2), ymax = V::set1(n2 - 2), zmax = V::set1(n3 - 2);
+  V::integer vn2 = V::set1i(n2), vn3 = V::set1i(n3), vone = V::set1i(1);
+  for(;p+V::width<=n;p+=V::width){
+    V::real dx = V::mul(V::load(x+p), vscale), dy = V::mul(V::load(y+p), vscale), dz = V::mul(V::load(z+p), vscale);
+    if(!V::all_within(dx, one, xmax) || !V::all_within(dy, one, ymax) || !V::all_within(dz, one, zmax)){
+      for(int l=p;l<p+V::width;l++){ //some of the 64 points need the periodic wrap
+	result[l] = separable_cubic<Weights>(grid, x[l]*scale, y[l]*scale, z[l]*scale);
+      }
+      continue;
+    }
+  
+    V::real fx = V::floor(dx), fy = V::floor(dy), fz = V::floor(dz);
+    V::real wx[4], wy[4], wz[4];
+    Weights::weights(V::sub(dx, fx), wx);
+    Weights::weights(V::sub(dy, fy), wy);
+    Weights::weights(V::sub(dz, fz), wz);
+    V::integer corner = V::addi(V::muli(V::addi(V::muli(V::to_int(fx), vn2), V::to_int(fy)), vn3), V::to_int(fz));
+    corner = V::addi(corner, V::set1i(-(n2*n3 + n3 + 1))); //the 64 points start one step below in every direction
+  
+    //summed in the same order as in the scalar version
+    V::real sum = V::set1(0);
+    for(int a=0;a<4;a++){
+      V::real sa = V::set1(0);
+      for(int b=0;b<4;b++){
+	V::integer idx = V::addi(corner, V::set1i(a*n2*n3 + b*n3));
+	V::real sb = V::set1(0);
+	for(int c=0;c<4;c++){
+	  sb = V::add(sb, V::mul(wz[c], V::gather(base, idx)));
+	  idx = V::addi(idx, vone);
+	}
+	sa = V::add(sa, V::mul(wy[b], sb));
+      }
+      sum = V::add(sum, V::mul(wx[a], sa));
+    }
+    V::store(result+p, sum);
+  }
+#endif
+  for(;p<n;p++){
+    result[p] = separable_cubic<Weights>(grid, x[p]*scale, y[p]*scale, z[p]*scale);
+  }
+}
+
+#endif
@@ -32,8 +32,8 @@ struct GlobalSettings{
   fptype maxkdiff; //maximum fraction of the reciprocal lattice vectors lengths extremal orbits can differ from each other to be taken as copies of each other
   fptype maxfreqdiff; //maximum fraction of the dhva frequency ...
   fptype minimumfreq; //minimum frequency, all smaller frequencies are neglected
-  int ip; //interpolator type, 0=linear, 1=cubic
-  int go; //graphical out put switch, 0=no, 1=yes
+  int ip; //interpolator type, 0=linear, 1=cubic, 2=spectral, 3=cubic B-spline
+  int go; //graphical output switch, 0=no, 1=bit-packed occupancy volume, 2=run-length encoded occupancy volume
 };
 
 #endif
@@ -0,0 +1,85 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//simd.hpp
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "typedefs.hpp"
+
+#ifndef SIMD_H
+#define SIMD_H
+
+//vector registers of fptype for the batched interpolation kernels
+//the instruction set is chosen at compile time, e.g. -mavx2 or -mavx512f, without either only the scalar code is built
+//there is deliberately no fused multiply-add, so the kernels round exactly like the scalar interpolators
+//the avx512 variants with explicit masks avoid spurious uninitialized warnings of gcc 12
+#if defined(__AVX512F__)
+#define DHVA_SIMD_WIDTH 16
+struct SimdVector{
+  typedef __m512 real;
+  typedef __m512i integer;
+  static const int width = 16;
+  static inline real load(const fptype* p) {return _mm512_loadu_ps(p);}
+  static inline void store(fptype* p, real a) {_mm512_storeu_ps(p, a);}
+  static inline real set1(fptype a) {return _mm512_set1_ps(a);}
+  static inline real add(real a, real b) {return _mm512_add_ps(a, b);}
+  static inline real sub(real a, real b) {return _mm512_sub_ps(a, b);}
+  static inline real mul(real a, real b) {return _mm512_mul_ps(a, b);}
+  static inline real div(real a, real b) {return _mm512_div_ps(a, b);}
+  static inline real floor(real a) {return _mm512_mask_roundscale_ps(a, 0xffff, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);}
+  static inline real trunc(real a) {return _mm512_mask_roundscale_ps(a, 0xffff, a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);}
+  static inline integer to_int(real a) {return _mm512_maskz_cvttps_epi32(0xffff, a);}
+  static inline integer set1i(int a) {return _mm512_set1_epi32(a);}
+  static inline integer addi(integer a, integer b) {return _mm512_add_epi32(a, b);}
+  static inline integer muli(integer a, integer b) {return _mm512_mullo_epi32(a, b);}
+  static inline real gather(const fptype* base, integer idx) {return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xffff, idx, base, 4);}
+  static inline bool all_within(real a, real lower, real upper) { //lower <= a < upper in every lane
+    return (_mm512_cmp_ps_mask(a, lower, _CMP_GE_OQ) & _mm512_cmp_ps_mask(a, upper, _CMP_LT_OQ)) == 0xffff;
+  }
+};
+#elif defined(__AVX2__)
+#define DHVA_SIMD_WIDTH 8
+struct SimdVector{
+  typedef __m256 real;
+  typedef __m256i integer;
+  static const int width = 8;
+  static inline real load(const fptype* p) {return _mm256_loadu_ps(p);}
+  static inline void store(fptype* p, real a) {_mm256_storeu_ps(p, a);}
+  static inline real set1(fptype a) {return _mm256_set1_ps(a);}
+  static inline real add(real a, real b) {return _mm256_add_ps(a, b);}
+  static inline real sub(real a, real b) {return _mm256_sub_ps(a, b);}
+  static inline real mul(real a, real b) {return _mm256_mul_ps(a, b);}
+  static inline real div(real a, real b) {return _mm256_div_ps(a, b);}
+  static inline real floor(real a) {return _mm256_round_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);}
+  static inline real trunc(real a) {return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);}
+  static inline integer to_int(real a) {return _mm256_cvttps_epi32(a);}
+  static inline integer set1i(int a) {return _mm256_set1_epi32(a);}
+  static inline integer addi(integer a, integer b) {return _mm256_add_epi32(a, b);}
+  static inline integer muli(integer a, integer b) {return _mm256_mullo_epi32(a, b);}
+  static inline real gather(const fptype* base, integer idx) {return _mm256_i32gather_ps(base, idx, 4);}
+  static inline bool all_within(real a, real lower, real upper) { //lower <= a < upper in every lane
+    real inside = _mm256_and_ps(_mm256_cmp_ps(a, lower, _CMP_GE_OQ), _mm256_cmp_ps(a, upper, _CMP_LT_OQ));
+    return _mm256_movemask_ps(inside) == 0xff;
+  }
+};
+#endif
+
+#endif
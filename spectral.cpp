@@ -0,0 +1,147 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//spectral.cpp
+#include "spectral.hpp"
+
+static const int maxrefinement = 4; //refinement of the band grid along each axis
+static const long refinedgridlimit = 256l << 20; //largest refined grid in bytes, the refinement is lowered for larger band grids
+
+SpectralInterpolator::SpectralInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const boost::array<int,3>& nkpoints){
+  
+  boost::array<int,3> extents; //unique points, the repeated last point along each axis is dropped
+  for(int l=0;l<3;l++){
+    extents[l] = max(nkpoints[l] - 1, 1);
+  }
+  
+  refinement = maxrefinement;
+  while((refinement > 1) && (long(refinement*extents[0])*(refinement*extents[1])*(refinement*extents[2])*long(sizeof(fptype)) > refinedgridlimit)){
+    refinement--;
+  }
+  
+  vector<fptype> values(long(extents[0])*extents[1]*extents[2]);
+  for(int i1=0;i1<extents[0];i1++){
+    for(int i2=0;i2<extents[1];i2++){
+      for(int i3=0;i3<extents[2];i3++){
+	values[(long(i1)*extents[1] + i2)*extents[2] + i3] = data[i1][i2][i3];
+      }
+    }
+  }
+  for(int l=0;l<3;l++){ //the transform is separable, so the axes are refined one after another
+    refine_axis(values, extents, l);
+  }
+  nrefined = extents;
+  refined = make_shared<const vector<fptype> >(move(values));
+  
+  boost::const_multi_array_ref<fptype,3> view(refined->data(), boost::extents[nrefined[0]][nrefined[1]][nrefined[2]]);
+  grid = make_shared<const InterpolationGrid>(view, nrefined);
+}
+
+void SpectralInterpolator::refine_axis(vector<fptype>& values, boost::array<int,3>& extents, int axis){
+  
+  int n = extents[axis], m = refinement*n;
+  boost::array<int,3> newextents = extents;
+  newextents[axis] = m;
+  
+  //strides of the axis and of the two other axes in the old and new grid
+  long stride = 1, newstride = 1;
+  for(int l=2;l>axis;l--){
+    stride *= extents[l];
+    newstride *= newextents[l];
+  }
+  long nouter = 1, ninner = stride;
+  for(int l=0;l<axis;l++){
+    nouter *= extents[l];
+  }
+  
+  vector<fptype> result(nouter*m*ninner);
+  FourierTransform forward(n), backward(m);
+  
+  //the lines are real, so two of them are transformed at once as real and imaginary part of one complex line
+  long nlines = nouter*ninner, npairs = (nlines + 1)/2;
+  #pragma omp parallel
+  {
+    vector<cplx> line(n), padded(m);
+    #pragma omp for schedule(static)
+    for(long pair=0;pair<npairs;pair++){
+      long first = 2*pair, second = min(2*pair + 1, nlines - 1);
+      const fptype* in1 = values.data() + (first / ninner)*n*stride + first % ninner;
+      const fptype* in2 = values.data() + (second / ninner)*n*stride + second % ninner;
+      fptype* out1 = result.data() + (first / ninner)*m*newstride + first % ninner;
+      fptype* out2 = result.data() + (second / ninner)*m*newstride + second % ninner;
+      
+      for(int k=0;k<n;k++){
+	line[k] = cplx(in1[k*stride], in2[k*stride]);
+      }
+      forward.forward(line);
+      
+      //zero padding between the positive and negative frequencies
+      fill(padded.begin(), padded.end(), cplx(0, 0));
+      for(int k=0;k<(n+1)/2;k++){
+	padded[k] = line[k];
+      }
+      for(int k=n/2+1;k<n;k++){
+	padded[m-n+k] = line[k];
+      }
+      if(n%2 == 0){ //the Nyquist frequency is split evenly between both signs to keep the series real
+	if(m > n){
+	  padded[n/2] = 0.5*line[n/2];
+	  padded[m-n/2] = 0.5*line[n/2];
+	}
+	else{
+	  padded[n/2] = line[n/2];
+	}
+      }
+      backward.inverse(padded);
+      
+      for(int k=0;k<m;k++){
+	out1[k*newstride] = padded[k].real()/n;
+	out2[k*newstride] = padded[k].imag()/n;
+      }
+    }
+  }
+  
+  values.swap(result);
+  extents = newextents;
+}
+
+fptype SpectralInterpolator::operator()(fptype x, fptype y, fptype z){
+  
+  //refined grid points are 1/refinement band grid spacings apart
+  return separable_cubic<CatmullRomWeights>(*grid, x*refinement, y*refinement, z*refinement);
+}
+
+fptype SpectralInterpolator::operator()(fptype x, fptype y, fptype z, fptype* gradient){
+  
+  fptype result = separable_cubic<CatmullRomWeights>(*grid, x*refinement, y*refinement, z*refinement, gradient);
+  for(int l=0;l<3;l++){
+    gradient[l] *= refinement;
+  }
+  return result;
+}
+
+void SpectralInterpolator::evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n){
+  
+  separable_cubic<CatmullRomWeights>(*grid, refinement, x, y, z, result, n);
+}
+
+int SpectralInterpolator::get_refinement(){
+  
+  return refinement;
+}
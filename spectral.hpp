@@ -0,0 +1,56 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//spectral.hpp
+#include <vector>
+#include <memory>
+#include <boost/array.hpp>
+#include <boost/multi_array.hpp>
+
+#include "typedefs.hpp"
+#include "fft.hpp"
+#include "grid.hpp"
+#include "separable.hpp"
+
+using namespace std;
+
+#ifndef SPECTRAL_INTERPOLATOR_H
+#define SPECTRAL_INTERPOLATOR_H
+
+class SpectralInterpolator{
+  //The band grid is periodic, its last point along each axis repeats the first one. The unique points are Fourier
+  //interpolated onto a grid refined by an integer factor, which is exact for band-limited energies. Points between
+  //the refined grid points are interpolated with tensor product Catmull-Rom splines, which equal the tricubic
+  //interpolator with finite difference derivatives but need only the 64 surrounding grid points.
+  //Evaluation does not modify the interpolator, copies share the refined grid.
+  public:
+    SpectralInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const boost::array<int,3>& nkpoints);
+    fptype operator()(fptype x, fptype y, fptype z);
+    fptype operator()(fptype x, fptype y, fptype z, fptype* gradient); //gradient in band grid spacings
+    void evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n);
+    int get_refinement();
+  private:
+    int refinement;
+    boost::array<int,3> nrefined; //number of points of the refined grid along each axis
+    shared_ptr<const vector<fptype> > refined;
+    shared_ptr<const InterpolationGrid> grid; //periodic view on the refined grid
+    void refine_axis(vector<fptype>& values, boost::array<int,3>& extents, int axis);
+};
+
+#endif
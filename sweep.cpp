@@ -0,0 +1,196 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//sweep.cpp
+#include "sweep.hpp"
+
+#ifdef DHVA_MPI
+enum SweepTag {TAG_ANGLE = 1, TAG_STOP, TAG_RESULT};
+#endif
+
+AngleSweep::AngleSweep(GlobalSettings& settings_in, const vector<pair<double,double> >& angles_in, const SweepOutput& output_in){
+  
+  settings = settings_in;
+  angles = angles_in;
+  output = output_in;
+  results.resize(angles.size());
+  done.assign(angles.size(), false);
+  nwritten = 0;
+}
+
+GlobalSettings AngleSweep::get_angle_settings(int a){
+  
+  GlobalSettings anglesettings = settings;
+  anglesettings.phi = angles[a].first/180*M_PI;
+  anglesettings.theta = angles[a].second/180*M_PI;
+  return anglesettings;
+}
+
+void AngleSweep::store(int a, vector<AveragedOrbit>& ao){
+  
+  //angles may finish in any order, every angle is written as soon as all angles before it are written
+  results[a].swap(ao);
+  done[a] = true;
+  int nangles = angles.size();
+  for(;(nwritten < nangles) && done[nwritten];nwritten++){
+    GlobalSettings anglesettings = get_angle_settings(nwritten);
+    if(output.sweepfilepath.empty()){
+      boost::filesystem::path outfilepath = get_output_name(output.outnameprefix, anglesettings) + ".out";
+      write_output(anglesettings, outfilepath, output.bandnumber, results[nwritten]);
+    }
+    else{
+      append_sweep_output(anglesettings, output.sweepfilepath, output.inputpath, output.inputhash, output.bandnumber, results[nwritten]);
+    }
+    vector<AveragedOrbit>().swap(results[nwritten]);
+    cout << boost::format("Finished angle phi = %3.1f, theta = %3.1f.") % angles[nwritten].first % angles[nwritten].second << endl;
+  }
+}
+
+void AngleSweep::run(ReciprocalUnitCell& ruc){
+  
+  ruc.prepare_interpolator(settings.ip); //built once, every angle evaluates a copy sharing its data
+  
+  //with enough angles every thread calculates whole angles, otherwise the angles are calculated one after another on all threads
+  int nangles = angles.size();
+  omp_set_max_active_levels(1);
+  #pragma omp parallel for schedule(dynamic) if(nangles >= omp_get_max_threads())
+  for(int a=0;a<nangles;a++){
+    GlobalSettings anglesettings = get_angle_settings(a);
+    vector<AveragedOrbit> ao = calc_extremal_orbits(anglesettings, ruc);
+    #pragma omp critical(sweep_output)
+    store(a, ao);
+  }
+}
+
+vector<AveragedOrbit> calc_extremal_orbits(GlobalSettings& settings, ReciprocalUnitCell& ruc){
+  
+  SuperCell sc(settings, ruc);
+  OrbitFinder orbit(settings, sc);
+  OrbitEvaluator eval(*orbit.get_orbits_pointer(), sc.get_grid());
+  SheetMatcher match(eval.get_evaluated_orbits());
+  FrequencyCalculator freqcalc(settings, match.get_sheets(), ruc.get_h());
+  return freqcalc.get_properties();
+}
+
+#ifdef DHVA_MPI
+//rank 0 reads the input file, broadcasts every band to the other ranks and hands out single angles to whichever rank is idle.
+//Results are sent back as raw bytes, so all ranks have to run the same executable on the same architecture.
+
+void AngleSweep::distribute(){
+  
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nangles = angles.size(), next = 0, nbusy = 0;
+  
+  for(int r=1;r<nranks;r++){
+    if(next < nangles){
+      double task[3] = {double(next), angles[next].first, angles[next].second};
+      MPI_Send(task, 3, MPI_DOUBLE, r, TAG_ANGLE, MPI_COMM_WORLD);
+      next++;
+      nbusy++;
+    }
+    else{
+      MPI_Send(NULL, 0, MPI_DOUBLE, r, TAG_STOP, MPI_COMM_WORLD);
+    }
+  }
+  
+  while(nbusy > 0){
+    MPI_Status status;
+    MPI_Probe(MPI_ANY_SOURCE, TAG_RESULT, MPI_COMM_WORLD, &status);
+    int nbytes;
+    MPI_Get_count(&status, MPI_BYTE, &nbytes);
+    vector<char> buffer(nbytes);
+    MPI_Recv(buffer.data(), nbytes, MPI_BYTE, status.MPI_SOURCE, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    
+    int a;
+    memcpy(&a, buffer.data(), sizeof(int));
+    vector<AveragedOrbit> ao((nbytes - sizeof(int))/sizeof(AveragedOrbit));
+    memcpy(ao.data(), buffer.data() + sizeof(int), ao.size()*sizeof(AveragedOrbit));
+    store(a, ao);
+    
+    if(next < nangles){
+      double task[3] = {double(next), angles[next].first, angles[next].second};
+      MPI_Send(task, 3, MPI_DOUBLE, status.MPI_SOURCE, TAG_ANGLE, MPI_COMM_WORLD);
+      next++;
+    }
+    else{
+      MPI_Send(NULL, 0, MPI_DOUBLE, status.MPI_SOURCE, TAG_STOP, MPI_COMM_WORLD);
+      nbusy--;
+    }
+  }
+}
+
+void broadcast_band(int bandnumber, const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h, const fptype* energies){
+  
+  int header[5] = {1, bandnumber, nkpoints[0], nkpoints[1], nkpoints[2]}; //the first entry is zero after the last band
+  MPI_Bcast(header, 5, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(const_cast<fptype*>(h.data()), 9*sizeof(fptype), MPI_BYTE, 0, MPI_COMM_WORLD);
+  long nbytes = long(nkpoints[0])*nkpoints[1]*nkpoints[2]*sizeof(fptype);
+  for(long offset=0;offset<nbytes;offset+=INT_MAX){ //the count of a single broadcast is limited to int
+    MPI_Bcast((char*)energies + offset, int(min(nbytes - offset, long(INT_MAX))), MPI_BYTE, 0, MPI_COMM_WORLD);
+  }
+}
+
+void broadcast_sweep_end(){
+  
+  int header[5] = {0, 0, 0, 0, 0};
+  MPI_Bcast(header, 5, MPI_INT, 0, MPI_COMM_WORLD);
+}
+
+void serve_sweep(GlobalSettings settings){
+  
+  while(true){
+    int header[5];
+    MPI_Bcast(header, 5, MPI_INT, 0, MPI_COMM_WORLD);
+    if(header[0] == 0){
+      break;
+    }
+    boost::array<int, 3> nkpoints = {{header[2], header[3], header[4]}};
+    boost::multi_array<fptype, 2> h(boost::extents[3][3]);
+    MPI_Bcast(h.data(), 9*sizeof(fptype), MPI_BYTE, 0, MPI_COMM_WORLD);
+    vector<fptype> energies(long(nkpoints[0])*nkpoints[1]*nkpoints[2]);
+    long nbytes = energies.size()*sizeof(fptype);
+    for(long offset=0;offset<nbytes;offset+=INT_MAX){
+      MPI_Bcast((char*)energies.data() + offset, int(min(nbytes - offset, long(INT_MAX))), MPI_BYTE, 0, MPI_COMM_WORLD);
+    }
+    
+    boost::const_multi_array_ref<fptype, 3> energyview(energies.data(), boost::extents[nkpoints[0]][nkpoints[1]][nkpoints[2]]);
+    ReciprocalUnitCell ruc(nkpoints, h, energyview);
+    ruc.prepare_interpolator(settings.ip);
+    
+    while(true){ //every angle is calculated on all threads of this rank
+      double task[3]; //index, phi and theta of the angle
+      MPI_Status status;
+      MPI_Recv(task, 3, MPI_DOUBLE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      if(status.MPI_TAG == TAG_STOP){
+	break;
+      }
+      int a = int(task[0]);
+      settings.phi = task[1]/180*M_PI;
+      settings.theta = task[2]/180*M_PI;
+      vector<AveragedOrbit> ao = calc_extremal_orbits(settings, ruc);
+      
+      vector<char> buffer(sizeof(int) + ao.size()*sizeof(AveragedOrbit));
+      memcpy(buffer.data(), &a, sizeof(int));
+      memcpy(buffer.data() + sizeof(int), ao.data(), ao.size()*sizeof(AveragedOrbit));
+      MPI_Send(buffer.data(), buffer.size(), MPI_BYTE, 0, TAG_RESULT, MPI_COMM_WORLD);
+    }
+  }
+}
+#endif
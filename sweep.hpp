@@ -0,0 +1,80 @@
+/*
+* Copyright (c) 2013, Daniel Guterding <guterding@itp.uni-frankfurt.de>
+*
+* This file is part of dhva.
+*
+* dhva is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* dhva is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with dhva. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//sweep.hpp
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <omp.h>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#ifdef DHVA_MPI
+#include <mpi.h>
+#endif
+
+#include "typedefs.hpp"
+#include "settings.hpp"
+#include "files.hpp"
+#include "ruc.hpp"
+#include "sc.hpp"
+#include "orbit.hpp"
+#include "eval.hpp"
+using namespace std;
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+struct SweepOutput{ //destination of the results of one band
+  string outnameprefix; //data folder and input file name, the settings of every angle are appended
+  boost::filesystem::path sweepfilepath; //if set, all results are appended to this file instead
+  boost::filesystem::path inputpath;
+  uint64_t inputhash;
+  int bandnumber;
+};
+
+class AngleSweep{ //extremal orbits of one band for many field directions, written in the order of the angles
+  public:
+    AngleSweep(GlobalSettings& settings_in, const vector<pair<double,double> >& angles_in, const SweepOutput& output_in);
+    void run(ReciprocalUnitCell& ruc); //all angles in this process
+#ifdef DHVA_MPI
+    void distribute(); //hands out the angles to all other ranks, which calculate them in serve_sweep
+#endif
+  private:
+    GlobalSettings settings;
+    vector<pair<double,double> > angles; //in degrees
+    SweepOutput output;
+    vector<vector<AveragedOrbit> > results; //finished angles that cannot be written yet
+    vector<bool> done;
+    int nwritten;
+    GlobalSettings get_angle_settings(int a);
+    void store(int a, vector<AveragedOrbit>& ao);
+};
+
+vector<AveragedOrbit> calc_extremal_orbits(GlobalSettings& settings, ReciprocalUnitCell& ruc);
+#ifdef DHVA_MPI
+void broadcast_band(int bandnumber, const boost::array<int, 3>& nkpoints, const boost::multi_array<fptype, 2>& h, const fptype* energies);
+void broadcast_sweep_end();
+void serve_sweep(GlobalSettings settings);
+#endif
+
+#endif
@@ -21,23 +21,20 @@
 #include "tricubic.hpp"
 
 //This code is adapted from https://github.com/deepzot/likely
-TriCubicInterpolator::TriCubicInterpolator(const boost::multi_array<fptype,3>& data, const fptype& spacing, const boost::array<int,3>& nkpoints){
+TriCubicInterpolator::TriCubicInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const fptype& spacing, const boost::array<int,3>& nkpoints) : _data(data, nkpoints){
   
   _initialized = false;
   _spacing = spacing;
   _n1 = nkpoints[0];
   _n2 = nkpoints[1];
   _n3 = nkpoints[2];
-  _data.resize(boost::extents[_n1*_n2*_n3]);
-  for(int k=0;k<_n3;k++){
-    for(int j=0;j<_n2;j++){
-      for(int i=0;i<_n1;i++)
-	_data[_index(i,j,k)] = data[i][j][k];
-    }
-  }
+}
+
+const Eigen::Matrix<fptype,64,64>& TriCubicInterpolator::_coefficient_matrix(){
   
+  //shared by all interpolators, so copies for several threads only copy the voxel cache
   //temporary array is necessary, otherwise compiler has problems with Eigen and takes very long to compile
-  int temp[64][64] = {
+  static const int temp[64][64] = {
     { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
     { 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
     {-3, 3, 0, 0, 0, 0, 0, 0,-2,-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
@@ -104,121 +101,259 @@ TriCubicInterpolator::TriCubicInterpolator(const boost::multi_array<fptype,3>& d
     { 8,-8,-8, 8,-8, 8, 8,-8, 4, 4,-4,-4,-4,-4, 4, 4, 4,-4, 4,-4,-4, 4,-4, 4, 4,-4,-4, 4, 4,-4,-4, 4, 2, 2, 2, 2,-2,-2,-2,-2, 2, 2,-2,-2, 2, 2,-2,-2, 2,-2, 2,-2, 2,-2, 2,-2, 1, 1, 1, 1, 1, 1, 1, 1}
   };
   
-  for(int i=0;i<64;i++){
-    for(int j=0;j<64;j++){
-      _C(i,j) = temp[i][j];
+  static const Eigen::Matrix<fptype,64,64> C = [](){ //initialized once, thread-safe
+    Eigen::Matrix<fptype,64,64> m;
+    for(int i=0;i<64;i++){
+      for(int j=0;j<64;j++){
+	m(i,j) = temp[i][j];
+      }
     }
-  }
+    return m;
+  }();
+  return C;
 }
 
-fptype TriCubicInterpolator::operator()(fptype x, fptype y, fptype z){
+void TriCubicInterpolator::precompute_coefficients(){
   
-  fptype dx = fmod(x/_spacing, _n1), dy = fmod(y/_spacing, _n2), dz = fmod(z/_spacing, _n3); //determine the relative position in the box enclosed by nearest data points
+  //coefficients of all voxels, voxels are independent and are calculated in parallel
+  long nvoxels = long(_n1)*_n2*_n3;
+  vector<fptype>* table = new vector<fptype>(64*nvoxels);
+  #pragma omp parallel for schedule(static)
+  for(int i1=0;i1<_n1;i1++){
+    Eigen::Matrix<fptype,64,1> coefs;
+    for(int i2=0;i2<_n2;i2++){
+      for(int i3=0;i3<_n3;i3++){
+	_calc_coefs(i1, i2, i3, coefs);
+	long voxel = (long(i1)*_n2 + i2)*_n3 + i3;
+	copy(coefs.data(), coefs.data() + 64, table->begin() + 64*voxel);
+      }
+    }
+  }
+  _table.reset(table);
+}
+
+shared_ptr<const vector<fptype> > TriCubicInterpolator::get_coefficient_table(){
   
-  if(dx < 0) dx += _n1; //periodicity is built in
-  if(dy < 0) dy += _n2;
-  if(dz < 0) dz += _n3;
+  return _table;
+}
+
+void TriCubicInterpolator::set_coefficient_table(shared_ptr<const vector<fptype> > table){
   
-  int xi = (int)floor(dx); //calculate lower-bound grid indices
-  int yi = (int)floor(dy);
-  int zi = (int)floor(dz);
+  _table = table;
+}
+
+void TriCubicInterpolator::_calc_coefs(int xi, int yi, int zi, Eigen::Matrix<fptype,64,1>& coefs) const{
   
-  // Check if we can re-use coefficients from the last interpolation.
-  if(!_initialized || xi != _i1 || yi != _i2 || zi != _i3) {
   // Extract the local vocal values and calculate partial derivatives.
   Eigen::Matrix<fptype,64,1> x;
   x << 
       // values of f(x,y,z) at each corner.
-      _data[_index(xi,yi,zi)],_data[_index(xi+1,yi,zi)],_data[_index(xi,yi+1,zi)],
-      _data[_index(xi+1,yi+1,zi)],_data[_index(xi,yi,zi+1)],_data[_index(xi+1,yi,zi+1)],
-      _data[_index(xi,yi+1,zi+1)],_data[_index(xi+1,yi+1,zi+1)],
+      _data(xi,yi,zi),_data(xi+1,yi,zi),_data(xi,yi+1,zi),
+      _data(xi+1,yi+1,zi),_data(xi,yi,zi+1),_data(xi+1,yi,zi+1),
+      _data(xi,yi+1,zi+1),_data(xi+1,yi+1,zi+1),
       // values of df/dx at each corner.
-      0.5*(_data[_index(xi+1,yi,zi)]-_data[_index(xi-1,yi,zi)]),
-      0.5*(_data[_index(xi+2,yi,zi)]-_data[_index(xi,yi,zi)]),
-      0.5*(_data[_index(xi+1,yi+1,zi)]-_data[_index(xi-1,yi+1,zi)]),
-      0.5*(_data[_index(xi+2,yi+1,zi)]-_data[_index(xi,yi+1,zi)]),
-      0.5*(_data[_index(xi+1,yi,zi+1)]-_data[_index(xi-1,yi,zi+1)]),
-      0.5*(_data[_index(xi+2,yi,zi+1)]-_data[_index(xi,yi,zi+1)]),
-      0.5*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi-1,yi+1,zi+1)]),
-      0.5*(_data[_index(xi+2,yi+1,zi+1)]-_data[_index(xi,yi+1,zi+1)]),
+      0.5*(_data(xi+1,yi,zi)-_data(xi-1,yi,zi)),
+      0.5*(_data(xi+2,yi,zi)-_data(xi,yi,zi)),
+      0.5*(_data(xi+1,yi+1,zi)-_data(xi-1,yi+1,zi)),
+      0.5*(_data(xi+2,yi+1,zi)-_data(xi,yi+1,zi)),
+      0.5*(_data(xi+1,yi,zi+1)-_data(xi-1,yi,zi+1)),
+      0.5*(_data(xi+2,yi,zi+1)-_data(xi,yi,zi+1)),
+      0.5*(_data(xi+1,yi+1,zi+1)-_data(xi-1,yi+1,zi+1)),
+      0.5*(_data(xi+2,yi+1,zi+1)-_data(xi,yi+1,zi+1)),
       // values of df/dy at each corner.
-      0.5*(_data[_index(xi,yi+1,zi)]-_data[_index(xi,yi-1,zi)]),
-      0.5*(_data[_index(xi+1,yi+1,zi)]-_data[_index(xi+1,yi-1,zi)]),
-      0.5*(_data[_index(xi,yi+2,zi)]-_data[_index(xi,yi,zi)]),
-      0.5*(_data[_index(xi+1,yi+2,zi)]-_data[_index(xi+1,yi,zi)]),
-      0.5*(_data[_index(xi,yi+1,zi+1)]-_data[_index(xi,yi-1,zi+1)]),
-      0.5*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi+1,yi-1,zi+1)]),
-      0.5*(_data[_index(xi,yi+2,zi+1)]-_data[_index(xi,yi,zi+1)]),
-      0.5*(_data[_index(xi+1,yi+2,zi+1)]-_data[_index(xi+1,yi,zi+1)]),
+      0.5*(_data(xi,yi+1,zi)-_data(xi,yi-1,zi)),
+      0.5*(_data(xi+1,yi+1,zi)-_data(xi+1,yi-1,zi)),
+      0.5*(_data(xi,yi+2,zi)-_data(xi,yi,zi)),
+      0.5*(_data(xi+1,yi+2,zi)-_data(xi+1,yi,zi)),
+      0.5*(_data(xi,yi+1,zi+1)-_data(xi,yi-1,zi+1)),
+      0.5*(_data(xi+1,yi+1,zi+1)-_data(xi+1,yi-1,zi+1)),
+      0.5*(_data(xi,yi+2,zi+1)-_data(xi,yi,zi+1)),
+      0.5*(_data(xi+1,yi+2,zi+1)-_data(xi+1,yi,zi+1)),
       // values of df/dz at each corner.
-      0.5*(_data[_index(xi,yi,zi+1)]-_data[_index(xi,yi,zi-1)]),
-      0.5*(_data[_index(xi+1,yi,zi+1)]-_data[_index(xi+1,yi,zi-1)]),
-      0.5*(_data[_index(xi,yi+1,zi+1)]-_data[_index(xi,yi+1,zi-1)]),
-      0.5*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi+1,yi+1,zi-1)]),
-      0.5*(_data[_index(xi,yi,zi+2)]-_data[_index(xi,yi,zi)]),
-      0.5*(_data[_index(xi+1,yi,zi+2)]-_data[_index(xi+1,yi,zi)]),
-      0.5*(_data[_index(xi,yi+1,zi+2)]-_data[_index(xi,yi+1,zi)]),
-      0.5*(_data[_index(xi+1,yi+1,zi+2)]-_data[_index(xi+1,yi+1,zi)]),
+      0.5*(_data(xi,yi,zi+1)-_data(xi,yi,zi-1)),
+      0.5*(_data(xi+1,yi,zi+1)-_data(xi+1,yi,zi-1)),
+      0.5*(_data(xi,yi+1,zi+1)-_data(xi,yi+1,zi-1)),
+      0.5*(_data(xi+1,yi+1,zi+1)-_data(xi+1,yi+1,zi-1)),
+      0.5*(_data(xi,yi,zi+2)-_data(xi,yi,zi)),
+      0.5*(_data(xi+1,yi,zi+2)-_data(xi+1,yi,zi)),
+      0.5*(_data(xi,yi+1,zi+2)-_data(xi,yi+1,zi)),
+      0.5*(_data(xi+1,yi+1,zi+2)-_data(xi+1,yi+1,zi)),
       // values of d2f/dxdy at each corner.
-      0.25*(_data[_index(xi+1,yi+1,zi)]-_data[_index(xi-1,yi+1,zi)]-_data[_index(xi+1,yi-1,zi)]+_data[_index(xi-1,yi-1,zi)]),
-      0.25*(_data[_index(xi+2,yi+1,zi)]-_data[_index(xi,yi+1,zi)]-_data[_index(xi+2,yi-1,zi)]+_data[_index(xi,yi-1,zi)]),
-      0.25*(_data[_index(xi+1,yi+2,zi)]-_data[_index(xi-1,yi+2,zi)]-_data[_index(xi+1,yi,zi)]+_data[_index(xi-1,yi,zi)]),
-      0.25*(_data[_index(xi+2,yi+2,zi)]-_data[_index(xi,yi+2,zi)]-_data[_index(xi+2,yi,zi)]+_data[_index(xi,yi,zi)]),
-      0.25*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi-1,yi+1,zi+1)]-_data[_index(xi+1,yi-1,zi+1)]+_data[_index(xi-1,yi-1,zi+1)]),
-      0.25*(_data[_index(xi+2,yi+1,zi+1)]-_data[_index(xi,yi+1,zi+1)]-_data[_index(xi+2,yi-1,zi+1)]+_data[_index(xi,yi-1,zi+1)]),
-      0.25*(_data[_index(xi+1,yi+2,zi+1)]-_data[_index(xi-1,yi+2,zi+1)]-_data[_index(xi+1,yi,zi+1)]+_data[_index(xi-1,yi,zi+1)]),
-      0.25*(_data[_index(xi+2,yi+2,zi+1)]-_data[_index(xi,yi+2,zi+1)]-_data[_index(xi+2,yi,zi+1)]+_data[_index(xi,yi,zi+1)]),
+      0.25*(_data(xi+1,yi+1,zi)-_data(xi-1,yi+1,zi)-_data(xi+1,yi-1,zi)+_data(xi-1,yi-1,zi)),
+      0.25*(_data(xi+2,yi+1,zi)-_data(xi,yi+1,zi)-_data(xi+2,yi-1,zi)+_data(xi,yi-1,zi)),
+      0.25*(_data(xi+1,yi+2,zi)-_data(xi-1,yi+2,zi)-_data(xi+1,yi,zi)+_data(xi-1,yi,zi)),
+      0.25*(_data(xi+2,yi+2,zi)-_data(xi,yi+2,zi)-_data(xi+2,yi,zi)+_data(xi,yi,zi)),
+      0.25*(_data(xi+1,yi+1,zi+1)-_data(xi-1,yi+1,zi+1)-_data(xi+1,yi-1,zi+1)+_data(xi-1,yi-1,zi+1)),
+      0.25*(_data(xi+2,yi+1,zi+1)-_data(xi,yi+1,zi+1)-_data(xi+2,yi-1,zi+1)+_data(xi,yi-1,zi+1)),
+      0.25*(_data(xi+1,yi+2,zi+1)-_data(xi-1,yi+2,zi+1)-_data(xi+1,yi,zi+1)+_data(xi-1,yi,zi+1)),
+      0.25*(_data(xi+2,yi+2,zi+1)-_data(xi,yi+2,zi+1)-_data(xi+2,yi,zi+1)+_data(xi,yi,zi+1)),
       // values of d2f/dxdz at each corner.
-      0.25*(_data[_index(xi+1,yi,zi+1)]-_data[_index(xi-1,yi,zi+1)]-_data[_index(xi+1,yi,zi-1)]+_data[_index(xi-1,yi,zi-1)]),
-      0.25*(_data[_index(xi+2,yi,zi+1)]-_data[_index(xi,yi,zi+1)]-_data[_index(xi+2,yi,zi-1)]+_data[_index(xi,yi,zi-1)]),
-      0.25*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi-1,yi+1,zi+1)]-_data[_index(xi+1,yi+1,zi-1)]+_data[_index(xi-1,yi+1,zi-1)]),
-      0.25*(_data[_index(xi+2,yi+1,zi+1)]-_data[_index(xi,yi+1,zi+1)]-_data[_index(xi+2,yi+1,zi-1)]+_data[_index(xi,yi+1,zi-1)]),
-      0.25*(_data[_index(xi+1,yi,zi+2)]-_data[_index(xi-1,yi,zi+2)]-_data[_index(xi+1,yi,zi)]+_data[_index(xi-1,yi,zi)]),
-      0.25*(_data[_index(xi+2,yi,zi+2)]-_data[_index(xi,yi,zi+2)]-_data[_index(xi+2,yi,zi)]+_data[_index(xi,yi,zi)]),
-      0.25*(_data[_index(xi+1,yi+1,zi+2)]-_data[_index(xi-1,yi+1,zi+2)]-_data[_index(xi+1,yi+1,zi)]+_data[_index(xi-1,yi+1,zi)]),
-      0.25*(_data[_index(xi+2,yi+1,zi+2)]-_data[_index(xi,yi+1,zi+2)]-_data[_index(xi+2,yi+1,zi)]+_data[_index(xi,yi+1,zi)]),
+      0.25*(_data(xi+1,yi,zi+1)-_data(xi-1,yi,zi+1)-_data(xi+1,yi,zi-1)+_data(xi-1,yi,zi-1)),
+      0.25*(_data(xi+2,yi,zi+1)-_data(xi,yi,zi+1)-_data(xi+2,yi,zi-1)+_data(xi,yi,zi-1)),
+      0.25*(_data(xi+1,yi+1,zi+1)-_data(xi-1,yi+1,zi+1)-_data(xi+1,yi+1,zi-1)+_data(xi-1,yi+1,zi-1)),
+      0.25*(_data(xi+2,yi+1,zi+1)-_data(xi,yi+1,zi+1)-_data(xi+2,yi+1,zi-1)+_data(xi,yi+1,zi-1)),
+      0.25*(_data(xi+1,yi,zi+2)-_data(xi-1,yi,zi+2)-_data(xi+1,yi,zi)+_data(xi-1,yi,zi)),
+      0.25*(_data(xi+2,yi,zi+2)-_data(xi,yi,zi+2)-_data(xi+2,yi,zi)+_data(xi,yi,zi)),
+      0.25*(_data(xi+1,yi+1,zi+2)-_data(xi-1,yi+1,zi+2)-_data(xi+1,yi+1,zi)+_data(xi-1,yi+1,zi)),
+      0.25*(_data(xi+2,yi+1,zi+2)-_data(xi,yi+1,zi+2)-_data(xi+2,yi+1,zi)+_data(xi,yi+1,zi)),
       // values of d2f/dydz at each corner.
-      0.25*(_data[_index(xi,yi+1,zi+1)]-_data[_index(xi,yi-1,zi+1)]-_data[_index(xi,yi+1,zi-1)]+_data[_index(xi,yi-1,zi-1)]),
-      0.25*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi+1,yi-1,zi+1)]-_data[_index(xi+1,yi+1,zi-1)]+_data[_index(xi+1,yi-1,zi-1)]),
-      0.25*(_data[_index(xi,yi+2,zi+1)]-_data[_index(xi,yi,zi+1)]-_data[_index(xi,yi+2,zi-1)]+_data[_index(xi,yi,zi-1)]),
-      0.25*(_data[_index(xi+1,yi+2,zi+1)]-_data[_index(xi+1,yi,zi+1)]-_data[_index(xi+1,yi+2,zi-1)]+_data[_index(xi+1,yi,zi-1)]),
-      0.25*(_data[_index(xi,yi+1,zi+2)]-_data[_index(xi,yi-1,zi+2)]-_data[_index(xi,yi+1,zi)]+_data[_index(xi,yi-1,zi)]),
-      0.25*(_data[_index(xi+1,yi+1,zi+2)]-_data[_index(xi+1,yi-1,zi+2)]-_data[_index(xi+1,yi+1,zi)]+_data[_index(xi+1,yi-1,zi)]),
-      0.25*(_data[_index(xi,yi+2,zi+2)]-_data[_index(xi,yi,zi+2)]-_data[_index(xi,yi+2,zi)]+_data[_index(xi,yi,zi)]),
-      0.25*(_data[_index(xi+1,yi+2,zi+2)]-_data[_index(xi+1,yi,zi+2)]-_data[_index(xi+1,yi+2,zi)]+_data[_index(xi+1,yi,zi)]),
+      0.25*(_data(xi,yi+1,zi+1)-_data(xi,yi-1,zi+1)-_data(xi,yi+1,zi-1)+_data(xi,yi-1,zi-1)),
+      0.25*(_data(xi+1,yi+1,zi+1)-_data(xi+1,yi-1,zi+1)-_data(xi+1,yi+1,zi-1)+_data(xi+1,yi-1,zi-1)),
+      0.25*(_data(xi,yi+2,zi+1)-_data(xi,yi,zi+1)-_data(xi,yi+2,zi-1)+_data(xi,yi,zi-1)),
+      0.25*(_data(xi+1,yi+2,zi+1)-_data(xi+1,yi,zi+1)-_data(xi+1,yi+2,zi-1)+_data(xi+1,yi,zi-1)),
+      0.25*(_data(xi,yi+1,zi+2)-_data(xi,yi-1,zi+2)-_data(xi,yi+1,zi)+_data(xi,yi-1,zi)),
+      0.25*(_data(xi+1,yi+1,zi+2)-_data(xi+1,yi-1,zi+2)-_data(xi+1,yi+1,zi)+_data(xi+1,yi-1,zi)),
+      0.25*(_data(xi,yi+2,zi+2)-_data(xi,yi,zi+2)-_data(xi,yi+2,zi)+_data(xi,yi,zi)),
+      0.25*(_data(xi+1,yi+2,zi+2)-_data(xi+1,yi,zi+2)-_data(xi+1,yi+2,zi)+_data(xi+1,yi,zi)),
       // values of d3f/dxdydz at each corner.
-      0.125*(_data[_index(xi+1,yi+1,zi+1)]-_data[_index(xi-1,yi+1,zi+1)]-_data[_index(xi+1,yi-1,zi+1)]+_data[_index(xi-1,yi-1,zi+1)]-_data[_index(xi+1,yi+1,zi-1)]+_data[_index(xi-1,yi+1,zi-1)]+_data[_index(xi+1,yi-1,zi-1)]-_data[_index(xi-1,yi-1,zi-1)]),
-      0.125*(_data[_index(xi+2,yi+1,zi+1)]-_data[_index(xi,yi+1,zi+1)]-_data[_index(xi+2,yi-1,zi+1)]+_data[_index(xi,yi-1,zi+1)]-_data[_index(xi+2,yi+1,zi-1)]+_data[_index(xi,yi+1,zi-1)]+_data[_index(xi+2,yi-1,zi-1)]-_data[_index(xi,yi-1,zi-1)]),
-      0.125*(_data[_index(xi+1,yi+2,zi+1)]-_data[_index(xi-1,yi+2,zi+1)]-_data[_index(xi+1,yi,zi+1)]+_data[_index(xi-1,yi,zi+1)]-_data[_index(xi+1,yi+2,zi-1)]+_data[_index(xi-1,yi+2,zi-1)]+_data[_index(xi+1,yi,zi-1)]-_data[_index(xi-1,yi,zi-1)]),
-      0.125*(_data[_index(xi+2,yi+2,zi+1)]-_data[_index(xi,yi+2,zi+1)]-_data[_index(xi+2,yi,zi+1)]+_data[_index(xi,yi,zi+1)]-_data[_index(xi+2,yi+2,zi-1)]+_data[_index(xi,yi+2,zi-1)]+_data[_index(xi+2,yi,zi-1)]-_data[_index(xi,yi,zi-1)]),
-      0.125*(_data[_index(xi+1,yi+1,zi+2)]-_data[_index(xi-1,yi+1,zi+2)]-_data[_index(xi+1,yi-1,zi+2)]+_data[_index(xi-1,yi-1,zi+2)]-_data[_index(xi+1,yi+1,zi)]+_data[_index(xi-1,yi+1,zi)]+_data[_index(xi+1,yi-1,zi)]-_data[_index(xi-1,yi-1,zi)]),
-      0.125*(_data[_index(xi+2,yi+1,zi+2)]-_data[_index(xi,yi+1,zi+2)]-_data[_index(xi+2,yi-1,zi+2)]+_data[_index(xi,yi-1,zi+2)]-_data[_index(xi+2,yi+1,zi)]+_data[_index(xi,yi+1,zi)]+_data[_index(xi+2,yi-1,zi)]-_data[_index(xi,yi-1,zi)]),
-      0.125*(_data[_index(xi+1,yi+2,zi+2)]-_data[_index(xi-1,yi+2,zi+2)]-_data[_index(xi+1,yi,zi+2)]+_data[_index(xi-1,yi,zi+2)]-_data[_index(xi+1,yi+2,zi)]+_data[_index(xi-1,yi+2,zi)]+_data[_index(xi+1,yi,zi)]-_data[_index(xi-1,yi,zi)]),
-      0.125*(_data[_index(xi+2,yi+2,zi+2)]-_data[_index(xi,yi+2,zi+2)]-_data[_index(xi+2,yi,zi+2)]+_data[_index(xi,yi,zi+2)]-_data[_index(xi+2,yi+2,zi)]+_data[_index(xi,yi+2,zi)]+_data[_index(xi+2,yi,zi)]-_data[_index(xi,yi,zi)])
+      0.125*(_data(xi+1,yi+1,zi+1)-_data(xi-1,yi+1,zi+1)-_data(xi+1,yi-1,zi+1)+_data(xi-1,yi-1,zi+1)-_data(xi+1,yi+1,zi-1)+_data(xi-1,yi+1,zi-1)+_data(xi+1,yi-1,zi-1)-_data(xi-1,yi-1,zi-1)),
+      0.125*(_data(xi+2,yi+1,zi+1)-_data(xi,yi+1,zi+1)-_data(xi+2,yi-1,zi+1)+_data(xi,yi-1,zi+1)-_data(xi+2,yi+1,zi-1)+_data(xi,yi+1,zi-1)+_data(xi+2,yi-1,zi-1)-_data(xi,yi-1,zi-1)),
+      0.125*(_data(xi+1,yi+2,zi+1)-_data(xi-1,yi+2,zi+1)-_data(xi+1,yi,zi+1)+_data(xi-1,yi,zi+1)-_data(xi+1,yi+2,zi-1)+_data(xi-1,yi+2,zi-1)+_data(xi+1,yi,zi-1)-_data(xi-1,yi,zi-1)),
+      0.125*(_data(xi+2,yi+2,zi+1)-_data(xi,yi+2,zi+1)-_data(xi+2,yi,zi+1)+_data(xi,yi,zi+1)-_data(xi+2,yi+2,zi-1)+_data(xi,yi+2,zi-1)+_data(xi+2,yi,zi-1)-_data(xi,yi,zi-1)),
+      0.125*(_data(xi+1,yi+1,zi+2)-_data(xi-1,yi+1,zi+2)-_data(xi+1,yi-1,zi+2)+_data(xi-1,yi-1,zi+2)-_data(xi+1,yi+1,zi)+_data(xi-1,yi+1,zi)+_data(xi+1,yi-1,zi)-_data(xi-1,yi-1,zi)),
+      0.125*(_data(xi+2,yi+1,zi+2)-_data(xi,yi+1,zi+2)-_data(xi+2,yi-1,zi+2)+_data(xi,yi-1,zi+2)-_data(xi+2,yi+1,zi)+_data(xi,yi+1,zi)+_data(xi+2,yi-1,zi)-_data(xi,yi-1,zi)),
+      0.125*(_data(xi+1,yi+2,zi+2)-_data(xi-1,yi+2,zi+2)-_data(xi+1,yi,zi+2)+_data(xi-1,yi,zi+2)-_data(xi+1,yi+2,zi)+_data(xi-1,yi+2,zi)+_data(xi+1,yi,zi)-_data(xi-1,yi,zi)),
+      0.125*(_data(xi+2,yi+2,zi+2)-_data(xi,yi+2,zi+2)-_data(xi+2,yi,zi+2)+_data(xi,yi,zi+2)-_data(xi+2,yi+2,zi)+_data(xi,yi+2,zi)+_data(xi+2,yi,zi)-_data(xi,yi,zi))
     ;
-    // Convert voxel values and partial derivatives to interpolation coefficients.
-    _coefs = _C * x;
-    // Remember this voxel for next time.
-    _i1 = xi;
-    _i2 = yi;
-    _i3 = zi;
-    _initialized = true;
+  // Convert voxel values and partial derivatives to interpolation coefficients.
+  coefs = _coefficient_matrix() * x;
+}
+
+const fptype* TriCubicInterpolator::_voxel_coefs(fptype& dx, fptype& dy, fptype& dz){
+  
+  dx = fmod(dx/_spacing, _n1), dy = fmod(dy/_spacing, _n2), dz = fmod(dz/_spacing, _n3); //determine the relative position in the box enclosed by nearest data points
+  
+  if(dx < 0) dx += _n1; //periodicity is built in
+  if(dy < 0) dy += _n2;
+  if(dz < 0) dz += _n3;
+  
+  int xi = (int)floor(dx); //calculate lower-bound grid indices
+  int yi = (int)floor(dy);
+  int zi = (int)floor(dz);
+  
+  const fptype* coefs;
+  if(_table){ //one lookup in the precomputed table
+    int i1 = (xi < _n1) ? xi : xi - _n1; //floating point rounding may put a point exactly on the upper border
+    int i2 = (yi < _n2) ? yi : yi - _n2;
+    int i3 = (zi < _n3) ? zi : zi - _n3;
+    coefs = _table->data() + 64*((long(i1)*_n2 + i2)*_n3 + i3);
+  }
+  else{
+    // Check if we can re-use coefficients from the last interpolation.
+    if(!_initialized || xi != _i1 || yi != _i2 || zi != _i3) {
+      _calc_coefs(xi, yi, zi, _coefs);
+      // Remember this voxel for next time.
+      _i1 = xi;
+      _i2 = yi;
+      _i3 = zi;
+      _initialized = true;
+    }
+    coefs = _coefs.data();
   }
-  // Evaluate the interpolation within this grid voxel.
   dx -= xi;
   dy -= yi;
   dz -= zi;
+  return coefs;
+}
+
+fptype TriCubicInterpolator::operator()(fptype x, fptype y, fptype z){
+  
+  fptype dx = x, dy = y, dz = z;
+  const fptype* coefs = _voxel_coefs(dx, dy, dz);
+  
+  // Evaluate the interpolation within this grid voxel.
   int ijkn(0);
   fptype dzpow(1);
   fptype result(0);
   for(int k = 0; k < 4; ++k) {
     fptype dypow(1);
     for(int j = 0; j < 4; ++j) {
-      result += dypow*dzpow*(_coefs[ijkn] + dx*(_coefs[ijkn+1] + dx*(_coefs[ijkn+2] + dx*_coefs[ijkn+3])));
+      result += dypow*dzpow*(coefs[ijkn] + dx*(coefs[ijkn+1] + dx*(coefs[ijkn+2] + dx*coefs[ijkn+3])));
+      ijkn += 4;
+      dypow *= dy;
+    }
+    dzpow *= dz;
+  }
+  return result;
+}
+
+fptype TriCubicInterpolator::operator()(fptype x, fptype y, fptype z, fptype* gradient){
+  
+  fptype dx = x, dy = y, dz = z;
+  const fptype* coefs = _voxel_coefs(dx, dy, dz);
+  
+  //the polynomial is differentiated term by term, d/dy dy^j = j dy^(j-1)
+  int ijkn(0);
+  fptype dzpow(1), ddzpow(0);
+  fptype result(0), gx(0), gy(0), gz(0);
+  for(int k = 0; k < 4; ++k) {
+    fptype dypow(1), ddypow(0);
+    for(int j = 0; j < 4; ++j) {
+      fptype poly = coefs[ijkn] + dx*(coefs[ijkn+1] + dx*(coefs[ijkn+2] + dx*coefs[ijkn+3]));
+      fptype dpoly = coefs[ijkn+1] + dx*(2*coefs[ijkn+2] + dx*3*coefs[ijkn+3]);
+      result += dypow*dzpow*poly;
+      gx += dypow*dzpow*dpoly;
+      gy += ddypow*dzpow*poly;
+      gz += dypow*ddzpow*poly;
       ijkn += 4;
+      ddypow = (j+1)*dypow;
       dypow *= dy;
     }
+    ddzpow = (k+1)*dzpow;
     dzpow *= dz;
   }
+  gradient[0] = gx/_spacing;
+  gradient[1] = gy/_spacing;
+  gradient[2] = gz/_spacing;
   return result;
 }
+
+void TriCubicInterpolator::evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n){
+  
+  int p = 0;
+#ifdef DHVA_SIMD_WIDTH
+  if(_table){ //without the table the coefficients are calculated per voxel and reused between neighbouring points
+    typedef SimdVector V;
+    const fptype* table = _table->data();
+    V::real zero = V::set1(0), spacing = V::set1(_spacing);
+    V::real n1 = V::set1(_n1), n2 = V::set1(_n2), n3 = V::set1(_n3);
+    V::integer vn2 = V::set1i(_n2), vn3 = V::set1i(_n3), v64 = V::set1i(64);
+    for(;p+V::width<=n;p+=V::width){
+      V::real dx = V::div(V::load(x+p), spacing), dy = V::div(V::load(y+p), spacing), dz = V::div(V::load(z+p), spacing);
+      if(!V::all_within(dx, zero, n1) || !V::all_within(dy, zero, n2) || !V::all_within(dz, zero, n3)){
+	for(int l=p;l<p+V::width;l++){ //some points need the periodic wrap
+	  result[l] = (*this)(x[l], y[l], z[l]);
+	}
+	continue;
+      }
+      
+      V::real fx = V::floor(dx), fy = V::floor(dy), fz = V::floor(dz);
+      V::integer voxel = V::muli(V::addi(V::muli(V::addi(V::muli(V::to_int(fx), vn2), V::to_int(fy)), vn3), V::to_int(fz)), v64);
+      dx = V::sub(dx, fx);
+      dy = V::sub(dy, fy);
+      dz = V::sub(dz, fz);
+      
+      //Horner scheme in the same order as in operator(), the coefficients of each lane are gathered from its voxel
+      V::real r = zero, dzpow = V::set1(1);
+      int ijkn = 0;
+      for(int k=0;k<4;k++){
+	V::real dypow = V::set1(1);
+	for(int j=0;j<4;j++){
+	  V::real poly = V::gather(table + ijkn + 3, voxel);
+	  poly = V::add(V::gather(table + ijkn + 2, voxel), V::mul(dx, poly));
+	  poly = V::add(V::gather(table + ijkn + 1, voxel), V::mul(dx, poly));
+	  poly = V::add(V::gather(table + ijkn, voxel), V::mul(dx, poly));
+	  r = V::add(r, V::mul(V::mul(dypow, dzpow), poly));
+	  ijkn += 4;
+	  dypow = V::mul(dypow, dy);
+	}
+	dzpow = V::mul(dzpow, dz);
+      }
+      V::store(result+p, r);
+    }
+  }
+#endif
+  for(;p<n;p++){
+    result[p] = (*this)(x[p], y[p], z[p]);
+  }
+}
@@ -18,36 +18,53 @@
 */
 
 //tricubic.hpp
+#include <vector>
+#include <memory>
 #include <Eigen/Dense>
 #include <boost/array.hpp>
 #include <boost/multi_array.hpp>
 
 #include "typedefs.hpp"
+#include "grid.hpp"
+#include "simd.hpp"
+
+using namespace std;
 
 #ifndef TRI_CUBIC_INTERPOLATOR_H
 #define TRI_CUBIC_INTERPOLATOR_H
 
+//largest tricubic coefficient table in megabytes, larger grids are interpolated on the fly, 0 disables the table
+//chosen at compile time, e.g. -DDHVA_TRICUBIC_TABLE_MB=1024
+#ifndef DHVA_TRICUBIC_TABLE_MB
+#define DHVA_TRICUBIC_TABLE_MB 256
+#endif
+const long tricubictablelimit = long(DHVA_TRICUBIC_TABLE_MB) << 20; //in bytes
+
 //This code is adapted from https://github.com/deepzot/likely
 class TriCubicInterpolator{
   // Performs tri-cubic interpolation within a 3D periodic grid.
   // Based on http://citeseerx.ist.psu.edu/viewdoc/summary?doi=10.1.1.89.7835
+  // Evaluation modifies the cache of the last voxel, so every thread needs its own copy. Copies share the band grid,
+  // the coefficient table and the matrix mapping voxel values to coefficients.
   public:
-    TriCubicInterpolator(const boost::multi_array<fptype,3>& data, const fptype& spacing, const boost::array<int,3>& nkpoints);
+    TriCubicInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const fptype& spacing, const boost::array<int,3>& nkpoints);
     fptype operator()(fptype x, fptype y, fptype z);
+    fptype operator()(fptype x, fptype y, fptype z, fptype* gradient); //gradient of the same polynomial, in units of 1/spacing
+    void evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n); //n points at once, same result as operator()
+    void precompute_coefficients();
+    shared_ptr<const vector<fptype> > get_coefficient_table();
+    void set_coefficient_table(shared_ptr<const vector<fptype> > table);
   private:
-    boost::multi_array<fptype,1> _data;
+    InterpolationGrid _data;
     fptype _spacing;
     int _n1, _n2, _n3;
     int _i1, _i2, _i3;
     bool _initialized;
     Eigen::Matrix<fptype,64,1> _coefs;
-    Eigen::Matrix<fptype,64,64> _C;
-    inline int _index(int i1, int i2, int i3) const {
-        if((i1 %= _n1) < 0) i1 += _n1;
-        if((i2 %= _n2) < 0) i2 += _n2;
-        if((i3 %= _n3) < 0) i3 += _n3;
-        return i1 + _n1*(i2 + _n2*i3);
-	}
+    shared_ptr<const vector<fptype> > _table; //64 coefficients per voxel in C order, null if they are calculated on the fly
+    static const Eigen::Matrix<fptype,64,64>& _coefficient_matrix(); //maps voxel values and derivatives to coefficients
+    void _calc_coefs(int xi, int yi, int zi, Eigen::Matrix<fptype,64,1>& coefs) const;
+    const fptype* _voxel_coefs(fptype& dx, fptype& dy, fptype& dz); //takes the coordinates, returns the coefficients of their voxel and the offsets within it
 };
 
 #endif
\ No newline at end of file
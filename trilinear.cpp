@@ -20,18 +20,8 @@
 //trilinear.cpp
 #include "trilinear.hpp"
 
-TriLinearInterpolator::TriLinearInterpolator(const boost::multi_array<fptype,3>& data_in, const boost::array<int,3>& nkpoints){
-  
-  n1 = nkpoints[0];
-  n2 = nkpoints[1];
-  n3 = nkpoints[2];
-  data.resize(boost::extents[n1*n2*n3]);
-  for(int k=0;k<n3;k++){
-    for(int j=0;j<n2;j++){
-      for(int i=0;i<n1;i++)
-	data[index(i,j,k)] = data_in[i][j][k];
-    }
-  }
+TriLinearInterpolator::TriLinearInterpolator(const boost::const_multi_array_ref<fptype,3>& data_in, const boost::array<int,3>& nkpoints) : data(data_in, nkpoints){
+  
 }
 
 fptype TriLinearInterpolator::operator()(fptype x, fptype y, fptype z){
@@ -42,17 +32,89 @@ fptype TriLinearInterpolator::operator()(fptype x, fptype y, fptype z){
   int yi = (int)floor(y);
   int zi = (int)floor(z);
   
-  fptype v000 = data[index(xi, yi, zi)];
-  fptype v100 = data[index(xi+1, yi, zi)];
-  fptype v010 = data[index(xi, yi+1, zi)];
-  fptype v001 = data[index(xi, yi, zi+1)];
-  fptype v101 = data[index(xi+1, yi, zi+1)];
-  fptype v011 = data[index(xi, yi+1, zi+1)];
-  fptype v110 = data[index(xi+1, yi+1, zi)];
-  fptype v111 = data[index(xi+1, yi+1, zi+1)];
+  fptype v000 = data(xi, yi, zi);
+  fptype v100 = data(xi+1, yi, zi);
+  fptype v010 = data(xi, yi+1, zi);
+  fptype v001 = data(xi, yi, zi+1);
+  fptype v101 = data(xi+1, yi, zi+1);
+  fptype v011 = data(xi, yi+1, zi+1);
+  fptype v110 = data(xi+1, yi+1, zi);
+  fptype v111 = data(xi+1, yi+1, zi+1);
  
   fptype result = v000*(1-dx)*(1-dy)*(1-dz) + v100*dx*(1-dy)*(1-dz) + v010*(1-dx)*dy*(1-dz) 
                 + v001*(1-dx)*(1-dy)*dz + v101*dx*(1-dy)*dz + v011*(1-dx)*dy*dz 
                 + v110*dx*dy*(1-dz) + v111*dx*dy*dz;
   return result;
 }
+
+fptype TriLinearInterpolator::operator()(fptype x, fptype y, fptype z, fptype* gradient){
+  
+  fptype dx = fmod(x, 1), dy = fmod(y, 1), dz = fmod(z, 1);
+  
+  int xi = (int)floor(x);
+  int yi = (int)floor(y);
+  int zi = (int)floor(z);
+  
+  fptype v000 = data(xi, yi, zi);
+  fptype v100 = data(xi+1, yi, zi);
+  fptype v010 = data(xi, yi+1, zi);
+  fptype v001 = data(xi, yi, zi+1);
+  fptype v101 = data(xi+1, yi, zi+1);
+  fptype v011 = data(xi, yi+1, zi+1);
+  fptype v110 = data(xi+1, yi+1, zi);
+  fptype v111 = data(xi+1, yi+1, zi+1);
+  
+  //interpolate along z first, the remaining bilinear form is differentiated by hand
+  fptype v00 = v000*(1-dz) + v001*dz;
+  fptype v10 = v100*(1-dz) + v101*dz;
+  fptype v01 = v010*(1-dz) + v011*dz;
+  fptype v11 = v110*(1-dz) + v111*dz;
+  
+  gradient[0] = (v10 - v00)*(1-dy) + (v11 - v01)*dy;
+  gradient[1] = (v01 - v00)*(1-dx) + (v11 - v10)*dx;
+  gradient[2] = (v001 - v000)*(1-dx)*(1-dy) + (v101 - v100)*dx*(1-dy) + (v011 - v010)*(1-dx)*dy + (v111 - v110)*dx*dy;
+  
+  return v00*(1-dx)*(1-dy) + v10*dx*(1-dy) + v01*(1-dx)*dy + v11*dx*dy;
+}
+
+void TriLinearInterpolator::evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n){
+  
+  int p = 0;
+#if defined(DHVA_SIMD_WIDTH) && !defined(DHVA_BRICKED_GRID)
+  typedef SimdVector V;
+  const fptype* base = data.get_data();
+  int n2 = data.get_n2(), n3 = data.get_n3();
+  V::real zero = V::set1(0), one = V::set1(1);
+  V::real xmax = V::set1(data.get_n1() - 1), ymax = V::set1(n2 - 1), zmax = V::set1(n3 - 1);
+  V::integer vn2 = V::set1i(n2), vn3 = V::set1i(n3);
+  V::integer sx = V::set1i(n2*n3), sy = V::set1i(n3), sz = V::set1i(1); //index strides of the upper corners
+  for(;p+V::width<=n;p+=V::width){
+    V::real vx = V::load(x+p), vy = V::load(y+p), vz = V::load(z+p);
+    if(!V::all_within(vx, zero, xmax) || !V::all_within(vy, zero, ymax) || !V::all_within(vz, zero, zmax)){
+      for(int l=p;l<p+V::width;l++){ //some corners need the periodic wrap
+	result[l] = (*this)(x[l], y[l], z[l]);
+      }
+      continue;
+    }
+    
+    V::real dx = V::sub(vx, V::trunc(vx)), dy = V::sub(vy, V::trunc(vy)), dz = V::sub(vz, V::trunc(vz)); //equals fmod for these coordinates
+    V::real ex = V::sub(one, dx), ey = V::sub(one, dy), ez = V::sub(one, dz);
+    V::integer i000 = V::addi(V::muli(V::addi(V::muli(V::to_int(V::floor(vx)), vn2), V::to_int(V::floor(vy))), vn3), V::to_int(V::floor(vz)));
+    V::integer i100 = V::addi(i000, sx), i010 = V::addi(i000, sy), i001 = V::addi(i000, sz);
+    
+    //the terms are summed in the same order as in operator()
+    V::real r = V::mul(V::mul(V::mul(V::gather(base, i000), ex), ey), ez);
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, i100), dx), ey), ez));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, i010), ex), dy), ez));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, i001), ex), ey), dz));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, V::addi(i100, sz)), dx), ey), dz));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, V::addi(i010, sz)), ex), dy), dz));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, V::addi(i100, sy)), dx), dy), ez));
+    r = V::add(r, V::mul(V::mul(V::mul(V::gather(base, V::addi(i100, V::addi(sy, sz))), dx), dy), dz));
+    V::store(result+p, r);
+  }
+#endif
+  for(;p<n;p++){
+    result[p] = (*this)(x[p], y[p], z[p]);
+  }
+}
@@ -23,6 +23,8 @@
 #include <boost/multi_array.hpp>
 
 #include "typedefs.hpp"
+#include "grid.hpp"
+#include "simd.hpp"
 
 using namespace std;
 
@@ -31,16 +33,11 @@ using namespace std;
 
 class TriLinearInterpolator{
   public:
-    TriLinearInterpolator(const boost::multi_array<fptype,3>& data, const boost::array<int,3>& nkpoints);
+    TriLinearInterpolator(const boost::const_multi_array_ref<fptype,3>& data, const boost::array<int,3>& nkpoints);
     fptype operator()(fptype x, fptype y, fptype z);
+    fptype operator()(fptype x, fptype y, fptype z, fptype* gradient); //gradient in grid spacings, discontinuous across grid planes
+    void evaluate(const fptype* x, const fptype* y, const fptype* z, fptype* result, int n); //n points at once, same result as operator()
   private:
-    boost::multi_array<fptype,1> data;
-    int n1, n2, n3;
-    inline int index(int i1, int i2, int i3) const {
-        if((i1 %= n1) < 0) i1 += n1;
-        if((i2 %= n2) < 0) i2 += n2;
-        if((i3 %= n3) < 0) i3 += n3;
-        return i1 + n1*(i2 + n2*i3);
-	}
+    InterpolationGrid data;
 };
 #endif
\ No newline at end of file
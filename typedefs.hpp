@@ -42,4 +42,29 @@
 #define RYDBERG2EV 13.6056925f
 #endif
 
-typedef float fptype;
\ No newline at end of file
+typedef float fptype;
+
+#ifndef TYPEDEFS_H
+#define TYPEDEFS_H
+
+typedef _Float16 half; //IEEE 754 binary16, arithmetic is carried out in float
+
+template <typename Storage, typename Accumulation> struct PrecisionPolicy{
+  typedef Storage storage_type; //energies of the super cell
+  typedef Accumulation accumulation_type; //sums over orbit points, e.g. areas and masses
+};
+
+//both types are chosen at compile time, e.g. -DDHVA_STORAGE=half -DDHVA_ACCUMULATION=double
+#ifndef DHVA_STORAGE
+#define DHVA_STORAGE float
+#endif
+
+#ifndef DHVA_ACCUMULATION
+#define DHVA_ACCUMULATION float
+#endif
+
+typedef PrecisionPolicy<DHVA_STORAGE, DHVA_ACCUMULATION> Precision;
+typedef Precision::storage_type storetype;
+typedef Precision::accumulation_type acctype;
+
+#endif
\ No newline at end of file